@@ -0,0 +1,313 @@
+// Standalone benchmark of the package's C++ entry points on synthetic
+// panels (no R needed). Each run times one configuration and writes a JSON
+// record; see README.md and bench.R (which sweeps a grid of them).
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <barry/barry.hpp>
+#include <barry/models/defm.hpp>
+
+#include "../src/defm-arrays.h"
+#include "../src/defm-likelihood.h"
+#include "../src/defm-simulate.h"
+#include "../src/defm-init.h"
+#include "synthetic.h"
+
+struct BenchConfig {
+  SyntheticConfig data;
+  size_t order     = 1u;
+  size_t n_terms_x = 1u;  ///< Intercepts interacted with a covariate.
+  int reps         = 5;
+  int ncores       = 1;
+  size_t nsim      = 10u;
+  std::string label;       ///< Free text (e.g., the commit hash.)
+  std::string out;         ///< Output file (stdout if empty.)
+};
+
+struct Timing {
+  std::string name;
+  std::vector< double > secs;
+};
+
+static void usage()
+{
+  std::fprintf(stderr,
+    "Usage: bench [--ids=500] [--times=5] [--ny=3] [--nx=1] [--levels=2]\n"
+    "             [--order=1] [--terms-x=1] [--reps=5] [--ncores=1]\n"
+    "             [--nsim=10] [--seed=1] [--label=] [--out=]\n"
+  );
+}
+
+static BenchConfig parse_args(int argc, char ** argv)
+{
+
+  BenchConfig cfg;
+  for (int a = 1; a < argc; ++a)
+  {
+
+    std::string arg(argv[a]);
+    if (arg == "--help")
+    {
+      usage();
+      std::exit(0);
+    }
+
+    size_t eq = arg.find('=');
+    if ((arg.compare(0u, 2u, "--") != 0) || (eq == std::string::npos))
+    {
+      usage();
+      throw std::invalid_argument("Invalid argument: " + arg);
+    }
+
+    std::string key = arg.substr(2u, eq - 2u);
+    std::string val = arg.substr(eq + 1u);
+    auto num = [&val]() -> size_t {return std::strtoull(val.c_str(), nullptr, 10);};
+
+    if (key == "ids")           cfg.data.n_ids   = num();
+    else if (key == "times")    cfg.data.n_times = num();
+    else if (key == "ny")       cfg.data.n_y     = num();
+    else if (key == "nx")       cfg.data.n_x     = num();
+    else if (key == "levels")   cfg.data.levels  = num();
+    else if (key == "seed")     cfg.data.seed    = num();
+    else if (key == "order")    cfg.order        = num();
+    else if (key == "terms-x")  cfg.n_terms_x    = num();
+    else if (key == "reps")     cfg.reps         = static_cast< int >(num());
+    else if (key == "ncores")   cfg.ncores       = static_cast< int >(num());
+    else if (key == "nsim")     cfg.nsim         = num();
+    else if (key == "label")    cfg.label        = val;
+    else if (key == "out")      cfg.out          = val;
+    else
+    {
+      usage();
+      throw std::invalid_argument("Unknown option: --" + key);
+    }
+
+  }
+
+  if ((cfg.data.n_x == 0u) || (cfg.data.levels == 0u))
+    cfg.n_terms_x = 0u;
+
+  if (cfg.reps < 1)
+    cfg.reps = 1;
+
+  if (cfg.data.n_times <= cfg.order)
+    throw std::invalid_argument("--times must be greater than --order.");
+
+  return cfg;
+
+}
+
+// Same terms bench.R uses: one intercept per outcome, `n_terms_x`
+// covariate-interacted intercepts, and one transition per outcome.
+static std::unique_ptr< defm::DEFM > build_model(
+  SyntheticPanel & d,
+  const BenchConfig & cfg
+) {
+
+  std::unique_ptr< defm::DEFM > m(new defm::DEFM(
+    d.ID.data(), d.Y.data(), d.X.data(), d.n_rows, d.n_y, d.n_x,
+    static_cast< int >(cfg.order), false
+  ));
+
+  m->set_names(d.Y_names, d.X_names);
+
+  defm::counter_logit_intercept(
+    m->get_counters(), d.n_y, {}, -1, &m->get_X_names(), &m->get_Y_names()
+  );
+
+  for (size_t t = 0u; t < cfg.n_terms_x; ++t)
+    defm::counter_logit_intercept(
+      m->get_counters(), d.n_y, {t % d.n_y}, static_cast< int >(t % d.n_x),
+      &m->get_X_names(), &m->get_Y_names()
+    );
+
+  for (size_t y = 0u; y < d.n_y; ++y)
+    defm::counter_formula(
+      m->get_counters(),
+      "{" + d.Y_names[y] + "_" + std::to_string(cfg.order - 1u) + "} > {" +
+        d.Y_names[y] + "_" + std::to_string(cfg.order) + "}",
+      cfg.order, d.n_y, &m->get_X_names(), &m->get_Y_names()
+    );
+
+  return m;
+
+}
+
+template< typename Setup, typename Run >
+static Timing time_it(const std::string & name, int reps, Setup setup, Run run)
+{
+
+  Timing res;
+  res.name = name;
+
+  for (int r = 0; r < reps; ++r)
+  {
+
+    setup();
+    auto t0 = std::chrono::steady_clock::now();
+    run();
+    auto t1 = std::chrono::steady_clock::now();
+    res.secs.push_back(std::chrono::duration< double >(t1 - t0).count());
+
+  }
+
+  return res;
+
+}
+
+static void write_json(
+  std::FILE * f,
+  const BenchConfig & cfg,
+  const SyntheticPanel & d,
+  const defm::DEFM & m,
+  const std::vector< Timing > & timings
+) {
+
+  const size_t n_arrays   = m.get_arrays2support()->size();
+  const size_t n_supports = m.get_stats_support_sizes()->size();
+
+  std::fprintf(f, "{\n  \"label\": \"%s\",\n", cfg.label.c_str());
+
+  #ifdef _OPENMP
+  std::fprintf(f, "  \"openmp\": true,\n");
+  #else
+  std::fprintf(f, "  \"openmp\": false,\n");
+  #endif
+
+  std::fprintf(f,
+    "  \"config\": {\"ids\": %zu, \"times\": %zu, \"ny\": %zu, \"nx\": %zu, "
+    "\"levels\": %zu, \"order\": %zu, \"terms_x\": %zu, \"ncores\": %d, "
+    "\"nsim\": %zu, \"seed\": %llu},\n",
+    cfg.data.n_ids, cfg.data.n_times, cfg.data.n_y, cfg.data.n_x,
+    cfg.data.levels, cfg.order, cfg.n_terms_x, cfg.ncores, cfg.nsim,
+    static_cast< unsigned long long >(cfg.data.seed)
+  );
+
+  std::fprintf(f,
+    "  \"model\": {\"rows\": %zu, \"terms\": %zu, \"arrays\": %zu, "
+    "\"supports\": %zu, \"cache_hit_rate\": %.6f},\n",
+    d.n_rows, m.nterms(), n_arrays, n_supports,
+    n_arrays > 0u ?
+      1.0 - static_cast< double >(n_supports) / static_cast< double >(n_arrays) :
+      0.0
+  );
+
+  std::fprintf(f, "  \"timings\": {\n");
+  for (size_t t = 0u; t < timings.size(); ++t)
+  {
+
+    std::vector< double > s = timings[t].secs;
+    std::sort(s.begin(), s.end());
+
+    std::fprintf(f, "    \"%s\": {\"min\": %.9f, \"median\": %.9f, \"secs\": [",
+      timings[t].name.c_str(), s.front(), s[s.size() / 2u]);
+
+    for (size_t r = 0u; r < timings[t].secs.size(); ++r)
+      std::fprintf(f, "%s%.9f", r > 0u ? ", " : "", timings[t].secs[r]);
+
+    std::fprintf(f, "]}%s\n", (t + 1u) < timings.size() ? "," : "");
+
+  }
+
+  std::fprintf(f, "  }\n}\n");
+
+}
+
+int main(int argc, char ** argv)
+{
+
+  try {
+
+    BenchConfig cfg     = parse_args(argc, argv);
+    SyntheticPanel data = synthetic_panel(cfg.data);
+    auto noop           = []() -> void {};
+
+    std::vector< Timing > timings;
+    std::unique_ptr< defm::DEFM > m;
+
+    timings.push_back(time_it("new_defm", cfg.reps,
+      [&]() {m.reset();},
+      [&]() {m = build_model(data, cfg);}
+    ));
+
+    timings.push_back(time_it("init_defm", cfg.reps,
+      [&]() {m = build_model(data, cfg);},
+      [&]() {m->init();}
+    ));
+
+    DEFMSupportStore store;
+    timings.push_back(time_it("init_defm_parallel", cfg.reps,
+      [&]() {store = DEFMSupportStore();},
+      [&]() {defm_init_parallel(*m, store, false, cfg.ncores, noop);}
+    ));
+
+    std::vector< double > par(m->nterms());
+    for (size_t j = 0u; j < par.size(); ++j)
+      par[j] = 0.1 * static_cast< double >(j % 3u) - 0.1;
+
+    double ll = 0.0;
+    timings.push_back(time_it("loglike_defm", cfg.reps, noop,
+      [&]() {ll += m->likelihood_total(par, true);}
+    ));
+
+    DEFMLikelihood loglike(*m);
+    std::vector< double > grad(par.size()), hess(par.size() * par.size());
+    timings.push_back(time_it("loglike_native", cfg.reps, noop,
+      [&]() {ll += loglike.eval(par.data(), nullptr, nullptr, cfg.ncores);}
+    ));
+
+    timings.push_back(time_it("loglike_grad_hess", cfg.reps, noop,
+      [&]() {ll += loglike.eval(par.data(), grad.data(), hess.data(), cfg.ncores);}
+    ));
+
+    std::vector< int > sims(data.n_rows * data.n_y * cfg.nsim);
+    timings.push_back(time_it("sim_defm", cfg.reps, noop,
+      [&]() {
+        DEFMSimSupport supports(*m, par);
+        defm_simulate(
+          *m, supports, cfg.data.seed, cfg.nsim, true, sims.data(),
+          cfg.ncores, noop
+        );
+      }
+    ));
+
+    std::vector< size_t > locs;
+    for (size_t y = 0u; y < data.n_y; ++y)
+      locs.push_back(y);
+
+    timings.push_back(time_it("motif_census", cfg.reps, noop,
+      [&]() {auto res = m->motif_census(locs); ll += res.size();}
+    ));
+
+    timings.push_back(time_it("logodds", cfg.reps, noop,
+      [&]() {auto res = m->logodds(par, cfg.order, 0u); ll += res[0];}
+    ));
+
+    // Keeps the compiler from dropping the calls
+    if (ll == 42.4242)
+      std::fprintf(stderr, "\n");
+
+    std::FILE * f = cfg.out.empty() ? stdout : std::fopen(cfg.out.c_str(), "w");
+    if (f == nullptr)
+      throw std::runtime_error("Cannot open " + cfg.out + " for writing.");
+
+    write_json(f, cfg, data, *m, timings);
+
+    if (f != stdout)
+      std::fclose(f);
+
+  } catch (const std::exception & e) {
+    std::fprintf(stderr, "Error: %s\n", e.what());
+    return 1;
+  }
+
+  return 0;
+
+}
@@ -0,0 +1,98 @@
+#ifndef DEFM_BENCH_SYNTHETIC_H
+#define DEFM_BENCH_SYNTHETIC_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "../src/defm-simulate.h"
+
+// Synthetic panel: `n_ids` individuals observed `n_times` times each, with
+// `n_y` binary outcomes and `n_x` time-invariant covariates taking `levels`
+// distinct values (0, ..., levels - 1). Each outcome is a Markov chain that
+// stays in its previous state with probability `persist`.
+//
+// The number of distinct support sets (and thus the support-cache hit rate
+// of init_defm()) grows with n_y, the Markov order, and `levels`, as
+// covariates that enter the terms make otherwise equal arrays differ.
+struct SyntheticConfig {
+  size_t n_ids      = 500u;
+  size_t n_times    = 5u;
+  size_t n_y        = 3u;
+  size_t n_x        = 1u;
+  size_t levels     = 2u;
+  double persist    = 0.7;
+  uint64_t seed     = 1u;
+};
+
+struct SyntheticPanel {
+  size_t n_rows = 0u, n_y = 0u, n_x = 0u;
+  std::vector< int > ID;
+  std::vector< int > Y;     ///< n_rows x n_y (column-major)
+  std::vector< double > X;  ///< n_rows x n_x (column-major)
+  std::vector< std::string > Y_names, X_names;
+};
+
+// Uses the same counter-based generator as the simulation functions, so a
+// given seed produces the same panel on any machine.
+inline SyntheticPanel synthetic_panel(const SyntheticConfig & cfg)
+{
+
+  SyntheticPanel d;
+  d.n_rows = cfg.n_ids * cfg.n_times;
+  d.n_y    = cfg.n_y;
+  d.n_x    = cfg.n_x;
+
+  d.ID.resize(d.n_rows);
+  d.Y.resize(d.n_rows * d.n_y);
+  d.X.resize(d.n_rows * d.n_x);
+
+  for (size_t y = 0u; y < d.n_y; ++y)
+    d.Y_names.push_back("y" + std::to_string(y));
+  for (size_t x = 0u; x < d.n_x; ++x)
+    d.X_names.push_back("x" + std::to_string(x));
+
+  uint64_t draw = 0u;
+  for (size_t i = 0u; i < cfg.n_ids; ++i)
+  {
+
+    std::vector< double > xi(d.n_x);
+    for (size_t x = 0u; x < d.n_x; ++x)
+      xi[x] = static_cast< double >(static_cast< size_t >(
+        counter_unif(cfg.seed, 0u, draw++) * static_cast< double >(cfg.levels)
+      ));
+
+    for (size_t t = 0u; t < cfg.n_times; ++t)
+    {
+
+      size_t row = i * cfg.n_times + t;
+      d.ID[row]  = static_cast< int >(i);
+
+      for (size_t x = 0u; x < d.n_x; ++x)
+        d.X[x * d.n_rows + row] = xi[x];
+
+      for (size_t y = 0u; y < d.n_y; ++y)
+      {
+
+        double u = counter_unif(cfg.seed, 1u, draw++);
+        int v;
+        if (t == 0u)
+          v = u < 0.5 ? 1 : 0;
+        else
+        {
+          int prev = d.Y[y * d.n_rows + row - 1u];
+          v = (u < cfg.persist) ? prev : (1 - prev);
+        }
+
+        d.Y[y * d.n_rows + row] = v;
+
+      }
+
+    }
+
+  }
+
+  return d;
+
+}
+
+#endif
@@ -83,6 +83,116 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// defm_fit_native_cpp
+List defm_fit_native_cpp(SEXP m, std::vector< double > start, bool trust_region, int maxit, double abstol, double reltol, double max_step, bool trace, int ncores);
+RcppExport SEXP _defm_defm_fit_native_cpp(SEXP mSEXP, SEXP startSEXP, SEXP trust_regionSEXP, SEXP maxitSEXP, SEXP abstolSEXP, SEXP reltolSEXP, SEXP max_stepSEXP, SEXP traceSEXP, SEXP ncoresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< std::vector< double > >::type start(startSEXP);
+    Rcpp::traits::input_parameter< bool >::type trust_region(trust_regionSEXP);
+    Rcpp::traits::input_parameter< int >::type maxit(maxitSEXP);
+    Rcpp::traits::input_parameter< double >::type abstol(abstolSEXP);
+    Rcpp::traits::input_parameter< double >::type reltol(reltolSEXP);
+    Rcpp::traits::input_parameter< double >::type max_step(max_stepSEXP);
+    Rcpp::traits::input_parameter< bool >::type trace(traceSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(defm_fit_native_cpp(m, start, trust_region, maxit, abstol, reltol, max_step, trace, ncores));
+    return rcpp_result_gen;
+END_RCPP
+}
+// boot_defm_cpp
+List boot_defm_cpp(SEXP m, std::vector< double > par, int R, int maxit, double abstol, double reltol, double max_step, int ncores);
+RcppExport SEXP _defm_boot_defm_cpp(SEXP mSEXP, SEXP parSEXP, SEXP RSEXP, SEXP maxitSEXP, SEXP abstolSEXP, SEXP reltolSEXP, SEXP max_stepSEXP, SEXP ncoresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< std::vector< double > >::type par(parSEXP);
+    Rcpp::traits::input_parameter< int >::type R(RSEXP);
+    Rcpp::traits::input_parameter< int >::type maxit(maxitSEXP);
+    Rcpp::traits::input_parameter< double >::type abstol(abstolSEXP);
+    Rcpp::traits::input_parameter< double >::type reltol(reltolSEXP);
+    Rcpp::traits::input_parameter< double >::type max_step(max_stepSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(boot_defm_cpp(m, par, R, maxit, abstol, reltol, max_step, ncores));
+    return rcpp_result_gen;
+END_RCPP
+}
+// defm_mcmc_cpp
+List defm_mcmc_cpp(SEXP m, const NumericMatrix& start, std::vector< double > prior_mean, std::vector< double > prior_sd, int nsteps, int burnin, int thin, bool mala, bool adapt, int ncores);
+RcppExport SEXP _defm_defm_mcmc_cpp(SEXP mSEXP, SEXP startSEXP, SEXP prior_meanSEXP, SEXP prior_sdSEXP, SEXP nstepsSEXP, SEXP burninSEXP, SEXP thinSEXP, SEXP malaSEXP, SEXP adaptSEXP, SEXP ncoresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< const NumericMatrix& >::type start(startSEXP);
+    Rcpp::traits::input_parameter< std::vector< double > >::type prior_mean(prior_meanSEXP);
+    Rcpp::traits::input_parameter< std::vector< double > >::type prior_sd(prior_sdSEXP);
+    Rcpp::traits::input_parameter< int >::type nsteps(nstepsSEXP);
+    Rcpp::traits::input_parameter< int >::type burnin(burninSEXP);
+    Rcpp::traits::input_parameter< int >::type thin(thinSEXP);
+    Rcpp::traits::input_parameter< bool >::type mala(malaSEXP);
+    Rcpp::traits::input_parameter< bool >::type adapt(adaptSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(defm_mcmc_cpp(m, start, prior_mean, prior_sd, nsteps, burnin, thin, mala, adapt, ncores));
+    return rcpp_result_gen;
+END_RCPP
+}
+// save_defm_cpp
+SEXP save_defm_cpp(SEXP m, std::string path);
+RcppExport SEXP _defm_save_defm_cpp(SEXP mSEXP, SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(save_defm_cpp(m, path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// load_defm_cpp
+SEXP load_defm_cpp(std::string path);
+RcppExport SEXP _defm_load_defm_cpp(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(load_defm_cpp(path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// new_defm_file_cpp
+SEXP new_defm_file_cpp(std::string path, std::string id, std::vector< std::string > y, std::vector< std::string > x, int order, std::string format, std::string sep, int chunk_size);
+RcppExport SEXP _defm_new_defm_file_cpp(SEXP pathSEXP, SEXP idSEXP, SEXP ySEXP, SEXP xSEXP, SEXP orderSEXP, SEXP formatSEXP, SEXP sepSEXP, SEXP chunk_sizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< std::string >::type id(idSEXP);
+    Rcpp::traits::input_parameter< std::vector< std::string > >::type y(ySEXP);
+    Rcpp::traits::input_parameter< std::vector< std::string > >::type x(xSEXP);
+    Rcpp::traits::input_parameter< int >::type order(orderSEXP);
+    Rcpp::traits::input_parameter< std::string >::type format(formatSEXP);
+    Rcpp::traits::input_parameter< std::string >::type sep(sepSEXP);
+    Rcpp::traits::input_parameter< int >::type chunk_size(chunk_sizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(new_defm_file_cpp(path, id, y, x, order, format, sep, chunk_size));
+    return rcpp_result_gen;
+END_RCPP
+}
+// write_defm_panel_cpp
+SEXP write_defm_panel_cpp(std::string path, IntegerVector id, IntegerMatrix Y, NumericMatrix X, std::vector< std::string > ynames, std::vector< std::string > xnames, bool append);
+RcppExport SEXP _defm_write_defm_panel_cpp(SEXP pathSEXP, SEXP idSEXP, SEXP YSEXP, SEXP XSEXP, SEXP ynamesSEXP, SEXP xnamesSEXP, SEXP appendSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type id(idSEXP);
+    Rcpp::traits::input_parameter< IntegerMatrix >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< std::vector< std::string > >::type ynames(ynamesSEXP);
+    Rcpp::traits::input_parameter< std::vector< std::string > >::type xnames(xnamesSEXP);
+    Rcpp::traits::input_parameter< bool >::type append(appendSEXP);
+    rcpp_result_gen = Rcpp::wrap(write_defm_panel_cpp(path, id, Y, X, ynames, xnames, append));
+    return rcpp_result_gen;
+END_RCPP
+}
 // new_defm
 SEXP new_defm(SEXP& id, SEXP& Y, SEXP& X, int order, bool copy_data);
 RcppExport SEXP _defm_new_defm(SEXP idSEXP, SEXP YSEXP, SEXP XSEXP, SEXP orderSEXP, SEXP copy_dataSEXP) {
@@ -130,13 +240,16 @@ BEGIN_RCPP
 END_RCPP
 }
 // init_defm
-SEXP init_defm(SEXP m, bool force_new);
-RcppExport SEXP _defm_init_defm(SEXP mSEXP, SEXP force_newSEXP) {
+SEXP init_defm(SEXP m, bool force_new, int ncores, bool factor_covar, int covar_bins);
+RcppExport SEXP _defm_init_defm(SEXP mSEXP, SEXP force_newSEXP, SEXP ncoresSEXP, SEXP factor_covarSEXP, SEXP covar_binsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
     Rcpp::traits::input_parameter< bool >::type force_new(force_newSEXP);
-    rcpp_result_gen = Rcpp::wrap(init_defm(m, force_new));
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    Rcpp::traits::input_parameter< bool >::type factor_covar(factor_covarSEXP);
+    Rcpp::traits::input_parameter< int >::type covar_bins(covar_binsSEXP);
+    rcpp_result_gen = Rcpp::wrap(init_defm(m, force_new, ncores, factor_covar, covar_bins));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -151,27 +264,67 @@ BEGIN_RCPP
 END_RCPP
 }
 // loglike_defm
-double loglike_defm(SEXP m, std::vector< double > par, bool as_log);
-RcppExport SEXP _defm_loglike_defm(SEXP mSEXP, SEXP parSEXP, SEXP as_logSEXP) {
+NumericVector loglike_defm(SEXP m, std::vector< double > par, bool as_log, std::string by, int ncores);
+RcppExport SEXP _defm_loglike_defm(SEXP mSEXP, SEXP parSEXP, SEXP as_logSEXP, SEXP bySEXP, SEXP ncoresSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
     Rcpp::traits::input_parameter< std::vector< double > >::type par(parSEXP);
     Rcpp::traits::input_parameter< bool >::type as_log(as_logSEXP);
-    rcpp_result_gen = Rcpp::wrap(loglike_defm(m, par, as_log));
+    Rcpp::traits::input_parameter< std::string >::type by(bySEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(loglike_defm(m, par, as_log, by, ncores));
+    return rcpp_result_gen;
+END_RCPP
+}
+// loglike_grad_defm
+NumericVector loglike_grad_defm(SEXP m, const std::vector< double >& par, int ncores);
+RcppExport SEXP _defm_loglike_grad_defm(SEXP mSEXP, SEXP parSEXP, SEXP ncoresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< const std::vector< double >& >::type par(parSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(loglike_grad_defm(m, par, ncores));
+    return rcpp_result_gen;
+END_RCPP
+}
+// hessian_defm
+NumericMatrix hessian_defm(SEXP m, const std::vector< double >& par, int ncores);
+RcppExport SEXP _defm_hessian_defm(SEXP mSEXP, SEXP parSEXP, SEXP ncoresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< const std::vector< double >& >::type par(parSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(hessian_defm(m, par, ncores));
+    return rcpp_result_gen;
+END_RCPP
+}
+// loglike_defm_batch
+NumericVector loglike_defm_batch(SEXP m, const NumericMatrix& par, int ncores);
+RcppExport SEXP _defm_loglike_defm_batch(SEXP mSEXP, SEXP parSEXP, SEXP ncoresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< const NumericMatrix& >::type par(parSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(loglike_defm_batch(m, par, ncores));
     return rcpp_result_gen;
 END_RCPP
 }
 // sim_defm
-IntegerMatrix sim_defm(SEXP m, std::vector< double > par, bool fill_t0);
-RcppExport SEXP _defm_sim_defm(SEXP mSEXP, SEXP parSEXP, SEXP fill_t0SEXP) {
+SEXP sim_defm(SEXP m, std::vector< double > par, bool fill_t0, int nsim, int ncores);
+RcppExport SEXP _defm_sim_defm(SEXP mSEXP, SEXP parSEXP, SEXP fill_t0SEXP, SEXP nsimSEXP, SEXP ncoresSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
     Rcpp::traits::input_parameter< std::vector< double > >::type par(parSEXP);
     Rcpp::traits::input_parameter< bool >::type fill_t0(fill_t0SEXP);
-    rcpp_result_gen = Rcpp::wrap(sim_defm(m, par, fill_t0));
+    Rcpp::traits::input_parameter< int >::type nsim(nsimSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(sim_defm(m, par, fill_t0, nsim, ncores));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -257,23 +410,26 @@ BEGIN_RCPP
 END_RCPP
 }
 // get_stats
-NumericMatrix get_stats(SEXP m);
-RcppExport SEXP _defm_get_stats(SEXP mSEXP) {
+NumericMatrix get_stats(SEXP m, int from, int to);
+RcppExport SEXP _defm_get_stats(SEXP mSEXP, SEXP fromSEXP, SEXP toSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
-    rcpp_result_gen = Rcpp::wrap(get_stats(m));
+    Rcpp::traits::input_parameter< int >::type from(fromSEXP);
+    Rcpp::traits::input_parameter< int >::type to(toSEXP);
+    rcpp_result_gen = Rcpp::wrap(get_stats(m, from, to));
     return rcpp_result_gen;
 END_RCPP
 }
 // motif_census_cpp
-NumericMatrix motif_census_cpp(SEXP m, std::vector<size_t> locs);
-RcppExport SEXP _defm_motif_census_cpp(SEXP mSEXP, SEXP locsSEXP) {
+List motif_census_cpp(SEXP m, Rcpp::List locs, int ncores);
+RcppExport SEXP _defm_motif_census_cpp(SEXP mSEXP, SEXP locsSEXP, SEXP ncoresSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
-    Rcpp::traits::input_parameter< std::vector<size_t> >::type locs(locsSEXP);
-    rcpp_result_gen = Rcpp::wrap(motif_census_cpp(m, locs));
+    Rcpp::traits::input_parameter< Rcpp::List >::type locs(locsSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(motif_census_cpp(m, locs, ncores));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -290,6 +446,18 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// logodds_all
+NumericVector logodds_all(SEXP m, const std::vector< double >& par, int ncores);
+RcppExport SEXP _defm_logodds_all(SEXP mSEXP, SEXP parSEXP, SEXP ncoresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< const std::vector< double >& >::type par(parSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(logodds_all(m, par, ncores));
+    return rcpp_result_gen;
+END_RCPP
+}
 // is_motif
 LogicalVector is_motif(SEXP m);
 RcppExport SEXP _defm_is_motif(SEXP mSEXP) {
@@ -300,6 +468,39 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// defm_profile_cpp
+List defm_profile_cpp(SEXP m);
+RcppExport SEXP _defm_defm_profile_cpp(SEXP mSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    rcpp_result_gen = Rcpp::wrap(defm_profile_cpp(m));
+    return rcpp_result_gen;
+END_RCPP
+}
+// defm_hash_diagnostics_cpp
+DataFrame defm_hash_diagnostics_cpp(SEXP m, int nsample, int ncores);
+RcppExport SEXP _defm_defm_hash_diagnostics_cpp(SEXP mSEXP, SEXP nsampleSEXP, SEXP ncoresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< int >::type nsample(nsampleSEXP);
+    Rcpp::traits::input_parameter< int >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(defm_hash_diagnostics_cpp(m, nsample, ncores));
+    return rcpp_result_gen;
+END_RCPP
+}
+// covar_bins_error
+NumericVector covar_bins_error(SEXP m, const std::vector< double >& par);
+RcppExport SEXP _defm_covar_bins_error(SEXP mSEXP, SEXP parSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::traits::input_parameter< SEXP >::type m(mSEXP);
+    Rcpp::traits::input_parameter< const std::vector< double >& >::type par(parSEXP);
+    rcpp_result_gen = Rcpp::wrap(covar_bins_error(m, par));
+    return rcpp_result_gen;
+END_RCPP
+}
 // td_ones
 SEXP td_ones(SEXP m, std::string covar);
 RcppExport SEXP _defm_td_ones(SEXP mSEXP, SEXP covarSEXP) {
@@ -380,14 +581,24 @@ static const R_CallMethodDef CallEntries[] = {
     {"_defm_set_counter_info_cpp", (DL_FUNC) &_defm_set_counter_info_cpp, 3},
     {"_defm_as_list_defm_counter_cpp", (DL_FUNC) &_defm_as_list_defm_counter_cpp, 1},
     {"_defm_length_defm_counters", (DL_FUNC) &_defm_length_defm_counters, 1},
+    {"_defm_defm_fit_native_cpp", (DL_FUNC) &_defm_defm_fit_native_cpp, 9},
+    {"_defm_boot_defm_cpp", (DL_FUNC) &_defm_boot_defm_cpp, 8},
+    {"_defm_defm_mcmc_cpp", (DL_FUNC) &_defm_defm_mcmc_cpp, 10},
+    {"_defm_save_defm_cpp", (DL_FUNC) &_defm_save_defm_cpp, 2},
+    {"_defm_load_defm_cpp", (DL_FUNC) &_defm_load_defm_cpp, 1},
+    {"_defm_new_defm_file_cpp", (DL_FUNC) &_defm_new_defm_file_cpp, 8},
+    {"_defm_write_defm_panel_cpp", (DL_FUNC) &_defm_write_defm_panel_cpp, 7},
     {"_defm_new_defm", (DL_FUNC) &_defm_new_defm, 5},
     {"_defm_set_names", (DL_FUNC) &_defm_set_names, 3},
     {"_defm_get_Y_names", (DL_FUNC) &_defm_get_Y_names, 1},
     {"_defm_get_X_names", (DL_FUNC) &_defm_get_X_names, 1},
-    {"_defm_init_defm", (DL_FUNC) &_defm_init_defm, 2},
+    {"_defm_init_defm", (DL_FUNC) &_defm_init_defm, 5},
     {"_defm_print_defm", (DL_FUNC) &_defm_print_defm, 1},
-    {"_defm_loglike_defm", (DL_FUNC) &_defm_loglike_defm, 3},
-    {"_defm_sim_defm", (DL_FUNC) &_defm_sim_defm, 3},
+    {"_defm_loglike_defm", (DL_FUNC) &_defm_loglike_defm, 5},
+    {"_defm_loglike_grad_defm", (DL_FUNC) &_defm_loglike_grad_defm, 3},
+    {"_defm_hessian_defm", (DL_FUNC) &_defm_hessian_defm, 3},
+    {"_defm_loglike_defm_batch", (DL_FUNC) &_defm_loglike_defm_batch, 3},
+    {"_defm_sim_defm", (DL_FUNC) &_defm_sim_defm, 5},
     {"_defm_print_stats", (DL_FUNC) &_defm_print_stats, 2},
     {"_defm_nterms_defm", (DL_FUNC) &_defm_nterms_defm, 1},
     {"_defm_names_defm", (DL_FUNC) &_defm_names_defm, 1},
@@ -396,10 +607,14 @@ static const R_CallMethodDef CallEntries[] = {
     {"_defm_ncol_defm_x", (DL_FUNC) &_defm_ncol_defm_x, 1},
     {"_defm_nobs_defm", (DL_FUNC) &_defm_nobs_defm, 1},
     {"_defm_morder_defm", (DL_FUNC) &_defm_morder_defm, 1},
-    {"_defm_get_stats", (DL_FUNC) &_defm_get_stats, 1},
-    {"_defm_motif_census_cpp", (DL_FUNC) &_defm_motif_census_cpp, 2},
+    {"_defm_get_stats", (DL_FUNC) &_defm_get_stats, 3},
+    {"_defm_motif_census_cpp", (DL_FUNC) &_defm_motif_census_cpp, 3},
     {"_defm_logodds", (DL_FUNC) &_defm_logodds, 4},
+    {"_defm_logodds_all", (DL_FUNC) &_defm_logodds_all, 3},
     {"_defm_is_motif", (DL_FUNC) &_defm_is_motif, 1},
+    {"_defm_defm_profile_cpp", (DL_FUNC) &_defm_defm_profile_cpp, 1},
+    {"_defm_defm_hash_diagnostics_cpp", (DL_FUNC) &_defm_defm_hash_diagnostics_cpp, 3},
+    {"_defm_covar_bins_error", (DL_FUNC) &_defm_covar_bins_error, 2},
     {"_defm_td_ones", (DL_FUNC) &_defm_td_ones, 2},
     {"_defm_td_generic", (DL_FUNC) &_defm_td_generic, 3},
     {"_defm_td_formula", (DL_FUNC) &_defm_td_formula, 3},
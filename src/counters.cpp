@@ -2,7 +2,7 @@
 
 // Lets barry check for user interrupts (Ctrl-C) during long-running
 // computations such as the support enumeration in init_defm().
-#define BARRY_USER_INTERRUPT Rcpp::checkUserInterrupt();
+#include "defm-interrupt.h"
 
 #include <barry/barry.hpp>
 #include <barry/models/defm.hpp>
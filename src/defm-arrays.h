@@ -0,0 +1,102 @@
+#ifndef DEFM_ARRAYS_H
+#define DEFM_ARRAYS_H
+
+#include <vector>
+
+// Helpers to map the model's data to arrays. They only need barry (no R),
+// so they can be used outside of the package (see benchmarks/.)
+
+// Maps the rows [from, to) of the data to their arrays, i.e., their position
+// in the model's stats_target. Rows that are part of the first m_order rows
+// of an id have no array (they are the starting condition), so they are
+// mapped to -1.
+inline void rows2arrays(
+  const int * ID,
+  size_t m_ord,
+  size_t from,
+  size_t to,
+  std::vector< int > & res
+) {
+
+  res.assign(to - from, -1);
+
+  int i_effective = 0;
+  size_t n_obs_i  = 0u;
+  for (size_t i = 0u; i < to; ++i)
+  {
+
+    // Do we need to reset the counter?
+    if ((i > 0) && (*(ID + i - 1u) != *(ID + i)))
+      n_obs_i = 0u;
+
+    // Did we passed the Markov order?
+    if (n_obs_i++ < m_ord)
+      continue;
+
+    if (i >= from)
+      res[i - from] = i_effective;
+
+    i_effective++;
+
+  }
+
+}
+
+inline void rows2arrays(
+  defm::DEFM & model,
+  size_t from,
+  size_t to,
+  std::vector< int > & res
+) {
+  rows2arrays(model.get_ID(), model.get_m_order(), from, to, res);
+}
+
+// Initializes `array` as the (m_order + 1) x n_y window of the data whose
+// first row is `start`, as DEFM::init() does. Only the covariates are set
+// here; the cells are left to the caller (they may come from simulated
+// data.) If `X` is not null, the covariates are read from it instead of the
+// model (same layout as the model's.)
+inline void init_array_window(
+  defm::DEFM & model,
+  defm::DEFMArray & array,
+  size_t start,
+  const double * X = nullptr
+) {
+
+  array = defm::DEFMArray(model.get_m_order() + 1u, model.get_n_y());
+  array.set_data(
+    new defm::DEFMData(
+      &array, X != nullptr ? X : model.get_X(), start, model.get_n_covars(),
+      model.get_n_rows(), true
+    ),
+    true
+  );
+
+}
+
+// Sets `array` to the window of the data starting at row `start`, with the
+// last row set to zero (the value used for hashing and enumerating.) `X`
+// overrides the model's covariates (see init_array_window().)
+inline void fill_array_window(
+  defm::DEFM & model,
+  defm::DEFMArray & array,
+  size_t start,
+  const double * X = nullptr
+) {
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const int * Y        = model.get_Y();
+
+  init_array_window(model, array, start, X);
+  for (size_t t = 0u; t < m_order; ++t)
+    for (size_t y = 0u; y < n_y; ++y)
+      array(t, y) = Y[y * nrows + start + t];
+
+  for (size_t y = 0u; y < n_y; ++y)
+    array(m_order, y) = 0;
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef DEFM_BITS_H
+#define DEFM_BITS_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// Binary rows (e.g., the possible last rows of a support, or the outcomes of
+// the data) stored as bits, `nwords` 64-bit words per row. Cell y is bit
+// (63 - y % 64) of word y / 64, so comparing two rows word by word (as
+// unsigned integers) orders them as comparing their cells lexicographically.
+class DEFMBitRows {
+private:
+
+  size_t ncols  = 0u;
+  size_t nwords = 0u;
+  size_t n      = 0u;
+  std::vector< uint64_t > bits;
+
+  static uint64_t bit(size_t y) {
+    return uint64_t(1u) << (63u - (y % 64u));
+  };
+
+public:
+
+  DEFMBitRows() {};
+  DEFMBitRows(size_t ncols_, size_t n_ = 0u) :
+    ncols(ncols_), nwords((ncols_ + 63u) / 64u), n(n_),
+    bits(n_ * ((ncols_ + 63u) / 64u), 0u) {};
+
+  // Packs `ncols` cells, read every `stride` ints, into `out` (nwords words)
+  static void pack(
+    const int * x, size_t ncols, uint64_t * out, size_t stride = 1u
+  ) {
+
+    std::fill(out, out + (ncols + 63u) / 64u, uint64_t(0u));
+    for (size_t y = 0u; y < ncols; ++y)
+      if (x[y * stride] != 0)
+        out[y / 64u] |= bit(y);
+
+  };
+
+  void resize(size_t n_) {
+    n = n_;
+    bits.resize(n * nwords, 0u);
+  };
+
+  void push_back(const int * x, size_t stride = 1u) {
+    bits.resize((n + 1u) * nwords);
+    pack(x, ncols, &bits[n++ * nwords], stride);
+  };
+
+  void set_row(size_t i, const int * x, size_t stride = 1u) {
+    pack(x, ncols, &bits[i * nwords], stride);
+  };
+
+  void copy_row(size_t i, const DEFMBitRows & other, size_t j) {
+    std::copy(other.row(j), other.row(j) + nwords, &bits[i * nwords]);
+  };
+
+  // Cell `y` of a packed row
+  static int get(const uint64_t * row, size_t y) {
+    return (row[y / 64u] & bit(y)) != 0u;
+  };
+
+  int get(size_t i, size_t y) const {return get(row(i), y);};
+
+  void unpack(size_t i, int * out) const {
+    for (size_t y = 0u; y < ncols; ++y)
+      out[y] = get(i, y);
+  };
+
+  const uint64_t * row(size_t i) const {return &bits[i * nwords];};
+
+  // Position of `key` (nwords words) among the rows, which must be sorted,
+  // or size() if it is not there.
+  size_t find(const uint64_t * key) const {
+
+    size_t lo = 0u, hi = n;
+    while (lo < hi)
+    {
+
+      size_t mid = (lo + hi) / 2u;
+      if (std::lexicographical_compare(row(mid), row(mid) + nwords, key, key + nwords))
+        lo = mid + 1u;
+      else
+        hi = mid;
+
+    }
+
+    if ((lo == n) || !std::equal(key, key + nwords, row(lo)))
+      return n;
+
+    return lo;
+
+  };
+
+  size_t size() const noexcept {return n;};
+  size_t ncol() const noexcept {return ncols;};
+  size_t words() const noexcept {return nwords;};
+  size_t bytes() const noexcept {return sizeof(uint64_t) * bits.size();};
+
+};
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef DEFM_COMMON_H
 #define DEFM_COMMON_H
 
-void check_covar(
+#include "defm-arrays.h"
+#include "defm-init.h"
+
+inline void check_covar(
   int & idx_,
   std::string & idx,
   Rcpp::XPtr< defm::DEFM > & ptr
@@ -29,4 +32,111 @@ void check_covar(
   }
 
 }
+
+// Draws a 64-bit seed from R's RNG (used to seed the counter-based
+// generator of the simulation functions.)
+inline uint64_t draw_seed()
+{
+
+  uint64_t seed = static_cast< uint64_t >(
+    R::unif_rand() * static_cast< double >(std::numeric_limits< uint32_t >::max())
+  );
+
+  return (seed << 32) | static_cast< uint64_t >(
+    R::unif_rand() * static_cast< double >(std::numeric_limits< uint32_t >::max())
+  );
+
+}
+
+// Returns the result of init_defm(m), stored in the attribute "native_init"
+// of the model, or nullptr if the model was not initialized (or a rule was
+// added since.)
+inline DEFMSupportStore * as_native_init(SEXP m)
+{
+
+  SEXP attr = Rf_getAttrib(m, Rf_install("native_init"));
+  if (attr == R_NilValue)
+    return nullptr;
+
+  Rcpp::XPtr< DEFMSupportStore > ptr(attr);
+  return ptr.get();
+
+}
+
+// Returns the counters and timers of the model (see defm_profile()), stored
+// in the attribute "profile" and created on first use. Models loaded with
+// load_defm() are not profiled (returns nullptr.)
+inline DEFMProfile * as_profile(SEXP m)
+{
+
+  if (!Rf_inherits(m, "DEFM"))
+    return nullptr;
+
+  SEXP attr = Rf_getAttrib(m, Rf_install("profile"));
+  if (attr == R_NilValue)
+  {
+
+    Rcpp::XPtr< DEFMProfile > ptr(new DEFMProfile(), true);
+    Rf_setAttrib(m, Rf_install("profile"), ptr);
+    return ptr.get();
+
+  }
+
+  Rcpp::XPtr< DEFMProfile > ptr(attr);
+  return ptr.get();
+
+}
+
+// Returns the array of each row of the data (see rows2arrays()), stored in
+// the attribute "row_arrays" and computed on first use, so reading the
+// statistics by chunks (get_stats(m, from, to)) does not scan the rows
+// before each chunk again. It only depends on the ids and the Markov order,
+// which do not change.
+inline const std::vector< int > * as_row_arrays(
+  SEXP m,
+  const int * ID,
+  size_t m_order,
+  size_t n_rows
+) {
+
+  SEXP attr = Rf_getAttrib(m, Rf_install("row_arrays"));
+  if (attr == R_NilValue)
+  {
+
+    Rcpp::XPtr< std::vector< int > > ptr(new std::vector< int >(), true);
+    rows2arrays(ID, m_order, 0u, n_rows, *ptr);
+    Rf_setAttrib(m, Rf_install("row_arrays"), ptr);
+    return ptr.get();
+
+  }
+
+  Rcpp::XPtr< std::vector< int > > ptr(attr);
+  return ptr.get();
+
+}
+
+// Returns the description of the terms of the model (see DEFMTermSpecs),
+// stored in the attribute "term_specs" and created on first use (if the
+// model already has terms by then, they are unknown.)
+inline DEFMTermSpecs * as_term_specs(SEXP m, defm::DEFM & model)
+{
+
+  SEXP attr = Rf_getAttrib(m, Rf_install("term_specs"));
+  if (attr == R_NilValue)
+  {
+
+    Rcpp::XPtr< DEFMTermSpecs > ptr(new DEFMTermSpecs(), true);
+    if (model.nterms() > 0u)
+      ptr->known = false;
+
+    Rf_setAttrib(m, Rf_install("term_specs"), ptr);
+    return ptr.get();
+
+  }
+
+  Rcpp::XPtr< DEFMTermSpecs > ptr(attr);
+  return ptr.get();
+
+}
+
 #endif
@@ -0,0 +1,216 @@
+#ifndef DEFM_DIAGNOSTICS_H
+#define DEFM_DIAGNOSTICS_H
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+#include "defm-init.h"
+
+// Contribution of each counter to the number of unique supports (see
+// defm_hash_diagnostics().)
+class DEFMHashDiagnostics {
+public:
+
+  size_t n_arrays   = 0u;
+  size_t n_supports = 0u;                ///< With all the counters.
+
+  std::vector< size_t > distinct;        ///< Distinct hashes of each counter.
+  std::vector< size_t > supports_without; ///< Unique supports without it.
+
+  // Measured on a sample of the supports
+  size_t n_sampled        = 0u;
+  double rows_per_support = 0.0;
+  double secs_per_support = 0.0;
+
+};
+
+// FNV-1a over the bytes of a hash, folded into `h`.
+inline uint64_t defm_fingerprint(
+  const std::vector< double > & hash,
+  uint64_t h = 1469598103934665603ULL
+) {
+
+  for (const auto & v : hash)
+  {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    for (size_t b = 0u; b < 8u; ++b)
+    {
+      h ^= (bits >> (b * 8u)) & 0xffu;
+      h *= 1099511628211ULL;
+    }
+  }
+
+  // Separates the hashes of consecutive counters
+  h ^= 0xffu;
+  h *= 1099511628211ULL;
+
+  return h;
+
+}
+
+// Hashes every array with each counter on its own (the key barry uses to
+// match supports is, counter by counter, the concatenation of these) and
+// counts, for each counter, the number of distinct hashes and the number
+// of unique supports the model would have without it. Hashes are compared
+// through 64-bit fingerprints.
+//
+// The first `nsample` unique supports are enumerated to measure their
+// average size and cost, which the caller can use to translate supports
+// into memory and time.
+inline void defm_hash_diagnostics(
+  defm::DEFM & model,
+  DEFMHashDiagnostics & res,
+  size_t nsample,
+  int ncores
+) {
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t m_order = model.get_m_order();
+  const size_t k       = model.nterms();
+
+  std::vector< int > rows;
+  rows2arrays(model, 0u, nrows, rows);
+
+  std::vector< size_t > starts;
+  for (size_t i = 0u; i < nrows; ++i)
+    if (rows[i] >= 0)
+      starts.push_back(i - m_order);
+
+  const size_t n_arrays = starts.size();
+
+  // Fingerprint of each counter's hash (n_arrays x k)
+  std::vector< uint64_t > fp(n_arrays * k);
+  DEFMThreadError err;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    defm::DEFMArray array;
+    std::vector< defm::DEFMCounters > single(k);
+    for (size_t j = 0u; j < k; ++j)
+      single[j].add_counter((*model.get_counters())[j]);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t a = 0u; a < n_arrays; ++a)
+    {
+
+      try {
+
+        fill_array_window(model, array, starts[a]);
+        for (size_t j = 0u; j < k; ++j)
+          fp[a * k + j] = defm_fingerprint(single[j].gen_hash(array));
+
+      } catch (const std::exception & e) {
+        err.set(e);
+      }
+
+    }
+
+  }
+
+  err.rethrow();
+
+  res.n_arrays = n_arrays;
+  res.distinct.assign(k, 0u);
+  res.supports_without.assign(k, 0u);
+
+  // Counting distinct keys: each counter alone, all of them, and all but
+  // one (j = k is "all of them".)
+  #ifdef _OPENMP
+  #pragma omp parallel for num_threads(ncores) schedule(dynamic)
+  #endif
+  for (size_t j = 0u; j <= k; ++j)
+  {
+
+    std::unordered_set< uint64_t > alone, without;
+    for (size_t a = 0u; a < n_arrays; ++a)
+    {
+
+      const uint64_t * f = &fp[a * k];
+
+      uint64_t h = 1469598103934665603ULL;
+      for (size_t l = 0u; l < k; ++l)
+        if (l != j)
+          h = (h ^ f[l]) * 1099511628211ULL;
+
+      without.insert(h);
+
+      if (j < k)
+        alone.insert(f[j]);
+
+    }
+
+    if (j < k)
+    {
+      res.distinct[j]         = alone.size();
+      res.supports_without[j] = without.size();
+    } else
+      res.n_supports = without.size();
+
+  }
+
+  // Sampling the supports of the first arrays with a distinct key
+  std::unordered_set< uint64_t > seen;
+  std::vector< size_t > sample;
+  for (size_t a = 0u; (a < n_arrays) && (sample.size() < nsample); ++a)
+  {
+
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t l = 0u; l < k; ++l)
+      h = (h ^ fp[a * k + l]) * 1099511628211ULL;
+
+    if (seen.insert(h).second)
+      sample.push_back(a);
+
+  }
+
+  res.n_sampled        = sample.size();
+  res.rows_per_support = 0.0;
+  res.secs_per_support = 0.0;
+
+  if (sample.size() == 0u)
+    return;
+
+  auto support = *model.get_support_fun();
+  defm::DEFMArray array;
+  std::vector< defm::DEFMArray > arrays;
+  std::vector< double > stats;
+
+  double nrow_total = 0.0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (const auto & a : sample)
+  {
+
+    fill_array_window(model, array, starts[a]);
+
+    arrays.clear();
+    stats.clear();
+    support.reset_array(array);
+    support.calc(&arrays, &stats);
+
+    nrow_total += static_cast< double >(arrays.size());
+
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  res.rows_per_support = nrow_total / static_cast< double >(sample.size());
+  res.secs_per_support = std::chrono::duration< double >(t1 - t0).count() /
+    static_cast< double >(sample.size());
+
+}
+
+#endif
@@ -0,0 +1,402 @@
+#include <Rcpp.h>
+
+// Lets barry check for user interrupts (Ctrl-C) during long-running
+// computations such as the support enumeration in init_defm().
+#include "defm-interrupt.h"
+
+#include <barry/barry.hpp>
+#include <barry/models/defm.hpp>
+#include "defm-common.h"
+#include "defm-fit.h"
+#include "defm-mcmc.h"
+#include "defm-simulate.h"
+#include "defm-io.h"
+
+using namespace Rcpp;
+
+// [[Rcpp::export(rng = false)]]
+List defm_fit_native_cpp(
+    SEXP m,
+    std::vector< double > start,
+    bool trust_region = false,
+    int maxit = 100,
+    double abstol = 1e-8,
+    double reltol = 1e-12,
+    double max_step = 5.0,
+    bool trace = false,
+    int ncores = 1
+  )
+{
+
+  std::vector< std::string > term_names;
+  DEFMLikelihood loglike = get_likelihood(m, &term_names);
+
+  size_t k = loglike.k;
+  if (start.size() != k)
+    stop(
+      "The length of -start- (" + std::to_string(start.size()) +
+      ") does not match the number of terms (" +
+      std::to_string(k) + ")."
+      );
+
+  if (maxit < 0)
+    stop("-maxit- must be non-negative.");
+
+  DEFMFitControl control;
+  control.maxit        = maxit;
+  control.abstol       = abstol;
+  control.reltol       = reltol;
+  control.max_step     = max_step;
+  control.trust_region = trust_region;
+  control.keep_trace   = trace;
+  control.ncores       = ncores;
+
+  // The fit evaluates the likelihood many times, so the column-wise copy
+  // of the supports pays for itself
+  loglike.pack();
+
+  DEFMFitResult ans = defm_fit_newton(loglike, start, control);
+
+  // Preparing the output
+  CharacterVector pnames = wrap(term_names);
+
+  NumericVector par  = wrap(ans.par);
+  NumericVector grad = wrap(ans.grad);
+  par.names()  = pnames;
+  grad.names() = pnames;
+
+  NumericMatrix hess(k, k);
+  std::copy(ans.hess.begin(), ans.hess.end(), hess.begin());
+  rownames(hess) = pnames;
+  colnames(hess) = pnames;
+
+  size_t ncol_trace = 3u + k;
+  size_t nrow_trace = ans.trace.size() / ncol_trace;
+  NumericMatrix trace_mat(nrow_trace, ncol_trace);
+  for (size_t i = 0u; i < nrow_trace; ++i)
+    for (size_t j = 0u; j < ncol_trace; ++j)
+      trace_mat(i, j) = ans.trace[i * ncol_trace + j];
+
+  CharacterVector tnames = {"loglik", "grad_max", "step"};
+  for (auto & n : pnames)
+    tnames.push_back(n);
+  colnames(trace_mat) = tnames;
+
+  return List::create(
+    _["par"]         = par,
+    _["loglik"]      = ans.loglik,
+    _["gradient"]    = grad,
+    _["hessian"]     = hess,
+    _["iterations"]  = ans.iterations,
+    _["convergence"] = ans.convergence,
+    _["trace"]       = trace_mat
+  );
+
+}
+
+// [[Rcpp::export(rng = true)]]
+List boot_defm_cpp(
+    SEXP m,
+    std::vector< double > par,
+    int R = 100,
+    int maxit = 100,
+    double abstol = 1e-8,
+    double reltol = 1e-12,
+    double max_step = 5.0,
+    int ncores = 1
+  )
+{
+
+  Rcpp::XPtr< defm::DEFM > ptr(m);
+
+  size_t k = ptr->nterms();
+  if (par.size() != k)
+    stop(
+      "The length of -par- (" + std::to_string(par.size()) +
+      ") does not match the number of terms (" +
+      std::to_string(k) + ")."
+      );
+
+  if (R < 1)
+    stop("-R- must be a positive integer.");
+
+  if (maxit < 0)
+    stop("-maxit- must be non-negative.");
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  size_t nrows = ptr->get_n_rows();
+  size_t nsim  = static_cast< size_t >(R);
+
+  // Step 1: Simulating the responses. The supports are enumerated once and
+  // shared by all the replicates (starting with those init_defm() already
+  // enumerated); `draws` records which support and which of its rows each
+  // simulated array used.
+  uint64_t seed = draw_seed();
+
+  DEFMSimSupport supports(*ptr, par);
+
+  const DEFMSupportStore * store = as_native_init(m);
+  if (store != nullptr)
+    supports.seed(*store, ncores);
+  std::vector< int > Y(nrows * ptr->get_n_y() * nsim);
+  std::vector< int > draws;
+
+  defm_simulate(
+    *ptr, supports, seed, nsim, true, Y.data(), ncores,
+    []() -> void {Rcpp::checkUserInterrupt();},
+    &draws
+  );
+
+  // Step 2: Refitting each replicate. Since the statistics of every
+  // possible array are already in the cache, a replicate's likelihood is
+  // given by the supports it used, how often, and the sum of its sampled
+  // statistics; nothing needs to be enumerated again.
+  size_t n_support = supports.size();
+
+  DEFMFitControl control;
+  control.maxit        = maxit;
+  control.abstol       = abstol;
+  control.reltol       = reltol;
+  control.max_step     = max_step;
+  control.keep_trace   = false;
+  control.ncores       = 1;
+
+  std::vector< double > estimates(nsim * k);
+  std::vector< double > loglik(nsim);
+  std::vector< int > convergence(nsim), iterations(nsim);
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    DEFMLikelihood loglike;
+    loglike.k = k;
+
+    std::vector< int > used(n_support, -1);
+    std::vector< size_t > touched;
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for (size_t r = 0u; r < nsim; ++r)
+    {
+
+      loglike.support.clear();
+      loglike.support_nrow.clear();
+      loglike.support_narrays.clear();
+      loglike.target_sum.assign(k, 0.0);
+      loglike.nrow_max = 0u;
+
+      for (size_t i = 0u; i < nrows; ++i)
+      {
+
+        int s = draws[2u * (r * nrows + i)];
+        if (s < 0)
+          continue;
+
+        int loc = draws[2u * (r * nrows + i) + 1u];
+
+        if (used[s] < 0)
+        {
+
+          used[s] = static_cast< int >(loglike.support.size());
+          touched.push_back(static_cast< size_t >(s));
+          loglike.support.push_back(supports.stats(s));
+          loglike.support_nrow.push_back(supports.nrow(s));
+          loglike.support_narrays.push_back(0.0);
+          loglike.nrow_max = std::max(loglike.nrow_max, supports.nrow(s));
+
+        }
+
+        loglike.support_narrays[used[s]] += 1.0;
+
+        const double * t = supports.stats(s) + loc * (k + 1u) + 1u;
+        for (size_t j = 0u; j < k; ++j)
+          loglike.target_sum[j] += t[j];
+
+      }
+
+      loglike.pack();
+      DEFMFitResult ans = defm_fit_newton(loglike, par, control);
+
+      std::copy(ans.par.begin(), ans.par.end(), estimates.begin() + r * k);
+      loglik[r]      = ans.loglik;
+      convergence[r] = ans.convergence;
+      iterations[r]  = ans.iterations;
+
+      // Resetting the map for the next replicate (the cache may hold many
+      // more supports than a replicate uses)
+      for (const auto & s : touched)
+        used[s] = -1;
+
+      touched.clear();
+
+    }
+
+  }
+
+  NumericMatrix res(nsim, k);
+  for (size_t r = 0u; r < nsim; ++r)
+    for (size_t j = 0u; j < k; ++j)
+      res(r, j) = estimates[r * k + j];
+
+  colnames(res) = wrap(ptr->colnames());
+
+  return List::create(
+    _["estimates"]   = res,
+    _["loglik"]      = wrap(loglik),
+    _["convergence"] = wrap(convergence),
+    _["iterations"]  = wrap(iterations),
+    _["n_supports"]  = static_cast< int >(n_support)
+  );
+
+}
+
+// [[Rcpp::export(rng = true)]]
+List defm_mcmc_cpp(
+    SEXP m,
+    const NumericMatrix & start,
+    std::vector< double > prior_mean,
+    std::vector< double > prior_sd,
+    int nsteps = 10000,
+    int burnin = 5000,
+    int thin = 1,
+    bool mala = false,
+    bool adapt = true,
+    int ncores = 1
+  )
+{
+
+  std::vector< std::string > term_names;
+  DEFMLikelihood loglike = get_likelihood(m, &term_names);
+
+  size_t k       = loglike.k;
+  size_t nchains = static_cast< size_t >(start.nrow());
+
+  if (static_cast< size_t >(start.ncol()) != k)
+    stop(
+      "The number of columns of -start- (" + std::to_string(start.ncol()) +
+      ") does not match the number of terms (" +
+      std::to_string(k) + ")."
+      );
+
+  if (nchains < 1u)
+    stop("-start- must have at least one row (one per chain).");
+
+  if ((nsteps < 1) || (burnin < 0) || (thin < 1))
+    stop("-nsteps- and -thin- must be positive and -burnin- non-negative.");
+
+  if (prior_mean.size() == 1u)
+    prior_mean.assign(k, prior_mean[0u]);
+
+  if (prior_sd.size() == 1u)
+    prior_sd.assign(k, prior_sd[0u]);
+
+  if ((prior_mean.size() != k) || (prior_sd.size() != k))
+    stop("-prior_mean- and -prior_sd- must be of length 1 or nterms_defm(m).");
+
+  for (const auto & sd : prior_sd)
+    if (!(sd > 0.0) || !std::isfinite(sd))
+      stop("-prior_sd- must be positive and finite.");
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  DEFMMCMCControl control;
+  control.nsteps     = static_cast< size_t >(nsteps);
+  control.burnin     = static_cast< size_t >(burnin);
+  control.thin       = static_cast< size_t >(thin);
+  control.mala       = mala;
+  control.adapt      = adapt;
+  control.prior_mean = prior_mean;
+  control.prior_sd   = prior_sd;
+
+  // Every chain evaluates the likelihood many times
+  loglike.pack();
+
+  uint64_t seed = draw_seed();
+
+  // The starting covariance is computed serially so the draws do not depend
+  // on the number of threads
+  std::vector< DEFMChain > chains;
+  chains.reserve(nchains);
+  for (size_t c = 0u; c < nchains; ++c)
+  {
+
+    std::vector< double > par(k);
+    for (size_t j = 0u; j < k; ++j)
+      par[j] = start(c, j);
+
+    chains.emplace_back(
+      loglike, control, par, defm_mcmc_sigma0(loglike, par, control), seed, c
+    );
+
+  }
+
+  // Chains run in parallel, one per thread, in segments so the main thread
+  // can check for user interrupts in between.
+  const size_t niter   = control.burnin + control.nsteps;
+  const size_t segment = 1000u;
+  for (size_t it = 0u; it < niter; it += segment)
+  {
+
+    const size_t n = std::min(segment, niter - it);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for num_threads(ncores) schedule(dynamic)
+    #endif
+    for (size_t c = 0u; c < nchains; ++c)
+      chains[c].run(n);
+
+    Rcpp::checkUserInterrupt();
+
+  }
+
+  // Stacking the chains
+  size_t nkeep = chains[0u].lp_draws.size();
+
+  NumericMatrix draws(nkeep * nchains, k);
+  NumericVector logpost(nkeep * nchains);
+  IntegerVector chain(nkeep * nchains);
+  NumericVector acceptance(nchains), scale(nchains);
+
+  for (size_t c = 0u; c < nchains; ++c)
+  {
+
+    for (size_t d = 0u; d < nkeep; ++d)
+    {
+
+      size_t row = c * nkeep + d;
+      for (size_t j = 0u; j < k; ++j)
+        draws(row, j) = chains[c].draws[d * k + j];
+
+      logpost[row] = chains[c].lp_draws[d];
+      chain[row]   = static_cast< int >(c + 1u);
+
+    }
+
+    acceptance[c] = chains[c].acceptance();
+    scale[c]      = chains[c].scale();
+
+  }
+
+  colnames(draws) = wrap(term_names);
+
+  return List::create(
+    _["draws"]      = draws,
+    _["logpost"]    = logpost,
+    _["chain"]      = chain,
+    _["acceptance"] = acceptance,
+    _["scale"]      = scale
+  );
+
+}
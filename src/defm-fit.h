@@ -0,0 +1,335 @@
+#ifndef DEFM_FIT_H
+#define DEFM_FIT_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "defm-likelihood.h"
+
+// Cholesky decomposition of a symmetric positive-definite A (k x k,
+// column-major): the factor L is stored in the lower triangle of A. Returns
+// false if A is not (numerically) positive-definite.
+inline bool chol_factor(std::vector< double > & A, size_t k)
+{
+
+  for (size_t j = 0u; j < k; ++j)
+  {
+
+    double d = A[j * k + j];
+    for (size_t l = 0u; l < j; ++l)
+      d -= A[l * k + j] * A[l * k + j];
+
+    if (!(d > 0.0) || !std::isfinite(d))
+      return false;
+
+    d = std::sqrt(d);
+    A[j * k + j] = d;
+
+    for (size_t i = j + 1u; i < k; ++i)
+    {
+
+      double v = A[j * k + i];
+      for (size_t l = 0u; l < j; ++l)
+        v -= A[l * k + i] * A[l * k + j];
+
+      A[j * k + i] = v / d;
+
+    }
+
+  }
+
+  return true;
+
+}
+
+// Solves A x = b given the Cholesky factor of A, as left in the lower
+// triangle of `L` by chol_factor(), by forward and backward substitution.
+inline void chol_backsolve(
+  const std::vector< double > & L,
+  const std::vector< double > & b,
+  std::vector< double > & x,
+  size_t k
+) {
+
+  // Forward (L y = b) and backward (L' x = y) substitution
+  x.assign(b.begin(), b.end());
+  for (size_t i = 0u; i < k; ++i)
+  {
+    for (size_t l = 0u; l < i; ++l)
+      x[i] -= L[l * k + i] * x[l];
+    x[i] /= L[i * k + i];
+  }
+
+  for (size_t i = k; i-- > 0u;)
+  {
+    for (size_t l = i + 1u; l < k; ++l)
+      x[i] -= L[i * k + l] * x[l];
+    x[i] /= L[i * k + i];
+  }
+
+}
+
+// Solves A x = b for a symmetric positive-definite A (k x k, column-major)
+// using a Cholesky decomposition. `A` is overwritten by the factor. Returns
+// false if A is not (numerically) positive-definite.
+inline bool chol_solve(
+  std::vector< double > & A,
+  const std::vector< double > & b,
+  std::vector< double > & x,
+  size_t k
+) {
+
+  if (!chol_factor(A, k))
+    return false;
+
+  chol_backsolve(A, b, x, k);
+
+  return true;
+
+}
+
+struct DEFMFitControl {
+  int maxit           = 100;
+  double abstol       = 1e-8;   ///< Largest absolute gradient component.
+  double reltol       = 1e-12;  ///< Relative change in the log-likelihood.
+  double max_step     = 5.0;    ///< Largest step (max-norm) per iteration.
+  bool trust_region   = false;
+  bool keep_trace     = true;
+  int ncores          = 1;
+};
+
+// Columns of the trace: loglik, max |gradient|, step length (Newton) or
+// damping (trust region), followed by the parameters.
+struct DEFMFitResult {
+  std::vector< double > par;
+  std::vector< double > grad;
+  std::vector< double > hess;
+  std::vector< double > trace;
+  double loglik   = 0.0;
+  int iterations  = 0;
+  int convergence = 1;  ///< 0: converged, 1: maxit reached, 2: failure.
+};
+
+// Maximizes the log-likelihood using Newton-Raphson iterations (with a
+// backtracking line search) or a Levenberg-Marquardt trust region. Either
+// way, if the Hessian is not negative-definite, the step is computed from a
+// damped version of it. All the work is done on the supports: each trial
+// point costs a DEFMLikelihood::eval() of the log-likelihood alone, and
+// each accepted one, an eval() with the gradient and the Hessian.
+inline DEFMFitResult defm_fit_newton(
+  const DEFMLikelihood & loglike,
+  const std::vector< double > & start,
+  const DEFMFitControl & control
+) {
+
+  const size_t k = loglike.k;
+
+  DEFMFitResult res;
+  res.par = start;
+  res.grad.resize(k);
+  res.hess.resize(k * k);
+
+  // Workspace (reused across iterations)
+  std::vector< double > A(k * k), step(k), par_new(k), grad_new(k);
+  std::vector< double > hess_new(k * k);
+
+  auto add_trace = [&](double ll, double step_size) -> void {
+
+    if (!control.keep_trace)
+      return;
+
+    double gmax = 0.0;
+    for (const auto & g : res.grad)
+      gmax = std::max(gmax, std::fabs(g));
+
+    res.trace.push_back(ll);
+    res.trace.push_back(gmax);
+    res.trace.push_back(step_size);
+    res.trace.insert(res.trace.end(), res.par.begin(), res.par.end());
+
+  };
+
+  // Solves (-H + lambda I) step = grad, increasing lambda until the
+  // system is positive-definite. Returns the lambda used.
+  auto newton_step = [&](const std::vector< double > & hess, double lambda) -> double {
+
+    double diag_max = 0.0;
+    for (size_t j = 0u; j < k; ++j)
+      diag_max = std::max(diag_max, std::fabs(hess[j * k + j]));
+
+    if (diag_max == 0.0)
+      diag_max = 1.0;
+
+    while (true)
+    {
+
+      for (size_t j = 0u; j < (k * k); ++j)
+        A[j] = -hess[j];
+
+      for (size_t j = 0u; j < k; ++j)
+        A[j * k + j] += lambda;
+
+      if (chol_solve(A, res.grad, step, k))
+        return lambda;
+
+      lambda = (lambda == 0.0) ? (1e-8 * diag_max) : (lambda * 10.0);
+
+      if (!std::isfinite(lambda))
+        return lambda;
+
+    }
+
+  };
+
+  res.loglik = loglike.eval(
+    res.par.data(), res.grad.data(), res.hess.data(), control.ncores
+  );
+
+  if (!std::isfinite(res.loglik))
+  {
+    res.convergence = 2;
+    return res;
+  }
+
+  add_trace(res.loglik, 0.0);
+
+  double lambda = 0.0;
+  for (res.iterations = 0; res.iterations < control.maxit; ++res.iterations)
+  {
+
+    double gmax = 0.0;
+    for (const auto & g : res.grad)
+      gmax = std::max(gmax, std::fabs(g));
+
+    if (gmax < control.abstol)
+    {
+      res.convergence = 0;
+      break;
+    }
+
+    if (!control.trust_region)
+      lambda = 0.0;
+
+    lambda = newton_step(res.hess, lambda);
+    if (!std::isfinite(lambda))
+    {
+      res.convergence = 2;
+      break;
+    }
+
+    // Capping the step
+    double smax = 0.0;
+    for (const auto & s : step)
+      smax = std::max(smax, std::fabs(s));
+
+    if (smax > control.max_step)
+      for (auto & s : step)
+        s *= control.max_step / smax;
+
+    double slope = 0.0;
+    for (size_t j = 0u; j < k; ++j)
+      slope += res.grad[j] * step[j];
+
+    double ll_new    = 0.0;
+    double step_size = 1.0;
+    bool accepted    = false;
+
+    if (!control.trust_region)
+    {
+
+      // Backtracking line search (Armijo condition). Trial points only need
+      // the log-likelihood; the derivatives are computed once accepted.
+      while (step_size > 1e-10)
+      {
+
+        for (size_t j = 0u; j < k; ++j)
+          par_new[j] = res.par[j] + step_size * step[j];
+
+        ll_new = loglike.eval(par_new.data(), nullptr, nullptr, control.ncores);
+
+        if (std::isfinite(ll_new) &&
+          (ll_new >= res.loglik + 1e-4 * step_size * slope))
+        {
+          accepted = true;
+          break;
+        }
+
+        step_size /= 2.0;
+
+      }
+
+    } else {
+
+      for (size_t j = 0u; j < k; ++j)
+        par_new[j] = res.par[j] + step[j];
+
+      ll_new = loglike.eval(par_new.data(), nullptr, nullptr, control.ncores);
+
+      // Ratio between the actual and the predicted (quadratic) increase
+      double predicted = slope;
+      for (size_t j = 0u; j < k; ++j)
+        for (size_t l = 0u; l < k; ++l)
+          predicted += 0.5 * step[j] * res.hess[l * k + j] * step[l];
+
+      double rho = (ll_new - res.loglik) / predicted;
+
+      if (!std::isfinite(ll_new) || !(rho > 0.0))
+      {
+
+        lambda = (lambda == 0.0) ? 1.0 : lambda * 4.0;
+        if (!std::isfinite(lambda))
+        {
+          res.convergence = 2;
+          break;
+        }
+
+        add_trace(res.loglik, lambda);
+        continue;
+
+      }
+
+      accepted = true;
+      if (rho > 0.75)
+        lambda /= 3.0;
+      else if (rho < 0.25)
+        lambda = (lambda == 0.0) ? 1.0 : lambda * 2.0;
+
+      step_size = lambda;
+
+    }
+
+    if (!accepted)
+    {
+      res.convergence = 2;
+      break;
+    }
+
+    // Derivatives at the accepted point
+    ll_new = loglike.eval(
+      par_new.data(), grad_new.data(), hess_new.data(), control.ncores
+    );
+
+    double ll_old = res.loglik;
+
+    std::swap(res.par, par_new);
+    std::swap(res.grad, grad_new);
+    std::swap(res.hess, hess_new);
+    res.loglik = ll_new;
+
+    add_trace(res.loglik, step_size);
+
+    if (std::fabs(res.loglik - ll_old) <
+      control.reltol * (std::fabs(ll_old) + control.reltol))
+    {
+      res.convergence = 0;
+      res.iterations++;
+      break;
+    }
+
+  }
+
+  return res;
+
+}
+
+#endif
@@ -0,0 +1,1713 @@
+#ifndef DEFM_INIT_H
+#define DEFM_INIT_H
+
+#include <vector>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "defm-likelihood.h"
+#include "defm-arrays.h"
+#include "defm-bits.h"
+#include "defm-terms.h"
+#include "defm-profile.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Result of initializing a DEFM natively (see defm_init_parallel()). It
+// holds the same information barry's DEFM::init() computes: the observed
+// statistics of each array, the support each array maps to, and the unique
+// supports in barry's layout (weight followed by the k statistics, with
+// rows sharing the statistics collapsed into one.)
+//
+// Unlike barry, it also keeps the possible last rows of each support (and
+// their statistics) so terms added after the initialization only need their
+// own column to be computed (see defm_extend_terms().)
+class DEFMSupportStore {
+public:
+
+  size_t k = 0u;
+  int ncores = 1;                         ///< Threads used to build it.
+  std::vector< double > target;           ///< n_arrays x k (row-major).
+  std::vector< size_t > arrays2support;   ///< Support of each array.
+  std::vector< size_t > support_nrow;     ///< Rows in each support.
+  std::vector< double > support;          ///< Supports, one after the other.
+
+  std::vector< size_t > starts;           ///< First row of each array.
+  std::vector< size_t > target_loc;       ///< Observed row in the support.
+  std::vector< size_t > owners;           ///< First array of each support.
+  std::vector< DEFMBitRows > rows;        ///< Possible last rows (sorted).
+  std::vector< std::vector< double > > stats; ///< Their statistics (n x k).
+
+  // The terms compiled (see defm_compile_checked()), set by the caller
+  // before initializing. When available, they count the statistics instead
+  // of barry's counters and, unless the model has rules they do not
+  // describe, enumerate the supports.
+  DEFMTermProgram program;
+
+  // Covariate factoring (see defm_init_factored().) The supports hold the
+  // statistics with all the covariates set to one, and each array scales
+  // them by its own multipliers. Arrays sharing a support and multipliers
+  // form a group, which is what the likelihood iterates over.
+  bool factored = false;
+  std::vector< size_t > group_support;    ///< Support of each group.
+  std::vector< double > group_scale;      ///< Multipliers (n_groups x k).
+  std::vector< double > group_narrays;    ///< Arrays in each group.
+  std::vector< size_t > arrays2group;     ///< Group of each array.
+
+  // Covariate quantization (see defm_init_quantized().) The supports and
+  // statistics are those of the quantized covariates; a sample of arrays
+  // keeps its exact supports and statistics to estimate the error.
+  int covar_bins = 0;                     ///< Bins (0 if not quantized.)
+  std::vector< size_t > check_arrays;     ///< Sampled arrays.
+  std::vector< double > check_target;     ///< Their exact statistics.
+  std::vector< std::vector< double > > check_support; ///< Their exact supports.
+
+  size_t n_arrays() const noexcept {return arrays2support.size();};
+  size_t n_support() const noexcept {return support_nrow.size();};
+
+  // Builds `support` from `stats`.
+  void collapse();
+
+  // The likelihood points to the store's memory, so it must not outlive it.
+  DEFMLikelihood likelihood() const;
+
+};
+
+inline void DEFMSupportStore::collapse()
+{
+
+  support.clear();
+  support_nrow.assign(stats.size(), 0u);
+
+  std::vector< size_t > ord;
+  for (size_t s = 0u; s < stats.size(); ++s)
+  {
+
+    const std::vector< double > & st = stats[s];
+    const size_t n = st.size() / k;
+
+    ord.resize(n);
+    for (size_t i = 0u; i < n; ++i)
+      ord[i] = i;
+
+    std::sort(ord.begin(), ord.end(), [&](size_t i, size_t j) {
+      return std::lexicographical_compare(
+        st.begin() + i * k, st.begin() + (i + 1u) * k,
+        st.begin() + j * k, st.begin() + (j + 1u) * k
+      );
+    });
+
+    for (size_t i = 0u; i < n; ++i)
+    {
+
+      const double * cur = &st[ord[i] * k];
+      if ((i > 0u) && std::equal(cur, cur + k, &st[ord[i - 1u] * k]))
+      {
+        // Same statistics as the previous row: increase its weight
+        support[support.size() - k - 1u] += 1.0;
+        continue;
+      }
+
+      support.push_back(1.0);
+      support.insert(support.end(), cur, cur + k);
+      support_nrow[s]++;
+
+    }
+
+  }
+
+}
+
+inline DEFMLikelihood DEFMSupportStore::likelihood() const
+{
+
+  DEFMLikelihood res;
+  res.k = k;
+
+  std::vector< const double * > start(n_support());
+
+  size_t offset = 0u;
+  for (size_t s = 0u; s < n_support(); ++s)
+  {
+    start[s]     = support.data() + offset;
+    res.nrow_max = std::max(res.nrow_max, support_nrow[s]);
+    offset      += support_nrow[s] * (k + 1u);
+  }
+
+  if (factored)
+  {
+
+    // One entry per group, pointing to the (shared) support
+    for (const auto & s : group_support)
+    {
+      res.support.push_back(start[s]);
+      res.support_nrow.push_back(support_nrow[s]);
+    }
+
+    res.support_narrays = group_narrays;
+    res.scale           = group_scale;
+
+  } else {
+
+    res.support      = start;
+    res.support_nrow = support_nrow;
+    res.support_narrays.assign(n_support(), 0.0);
+
+    for (const auto & s : arrays2support)
+      res.support_narrays[s] += 1.0;
+
+  }
+
+  res.target_sum.assign(k, 0.0);
+  for (size_t a = 0u; a < n_arrays(); ++a)
+    for (size_t j = 0u; j < k; ++j)
+      res.target_sum[j] += target[a * k + j];
+
+  return res;
+
+}
+
+// A store whose number of terms no longer matches the model's is outdated
+// (e.g., adding a term failed to extend it), and cannot be used.
+inline void check_native_init(
+  const DEFMSupportStore * store,
+  defm::DEFM & model
+) {
+
+  if ((store != nullptr) && (store->k != model.nterms()))
+    throw std::logic_error(
+      "The terms of the model changed after init_defm(). Initialize it again."
+    );
+
+}
+
+// Collects the first error thrown by any thread so it can be rethrown
+// once the parallel region is done.
+class DEFMThreadError {
+private:
+  std::string msg;
+  std::mutex lock;
+public:
+  void set(const std::exception & e) {
+    std::lock_guard< std::mutex > guard(lock);
+    if (msg == "")
+      msg = e.what();
+  };
+  void rethrow() const {
+    if (msg != "")
+      throw std::runtime_error(msg);
+  };
+};
+
+// Striped-lock hash map used to deduplicate the supports across threads.
+// Each key is owned by the first array (lowest index) that has it, which
+// makes the numbering of the supports independent of the thread schedule.
+class DEFMSupportKeys {
+private:
+
+  static const size_t nshards = 64u;
+
+  std::vector< std::map< std::vector< double >, size_t > > shards;
+  std::vector< std::mutex > locks;
+
+  static size_t shard(const std::vector< double > & key) {
+
+    // FNV-1a over the bytes of the key
+    uint64_t h = 1469598103934665603ULL;
+    for (const auto & v : key)
+    {
+      uint64_t bits;
+      std::memcpy(&bits, &v, sizeof(bits));
+      for (size_t b = 0u; b < 8u; ++b)
+      {
+        h ^= (bits >> (b * 8u)) & 0xffu;
+        h *= 1099511628211ULL;
+      }
+    }
+
+    return static_cast< size_t >(h % nshards);
+
+  };
+
+public:
+
+  DEFMSupportKeys() : shards(nshards), locks(nshards) {};
+
+  void claim(const std::vector< double > & key, size_t a) {
+
+    size_t s = shard(key);
+    std::lock_guard< std::mutex > guard(locks[s]);
+
+    auto res = shards[s].emplace(key, a);
+    if (!res.second && (res.first->second > a))
+      res.first->second = a;
+
+  };
+
+  // Only called once all the claims are done (no locking needed.)
+  size_t owner(const std::vector< double > & key) const {
+    return shards[shard(key)].find(key)->second;
+  };
+
+};
+
+// Hashes all the arrays in parallel (with all the model's counters) and
+// returns, for each array, the first array with the same key. With
+// `parent`, keys are only compared within arrays sharing the same parent
+// support, and only the counters from `from` on are used (the others are
+// already accounted for by the parent.) `X` overrides the model's
+// covariates (see init_array_window().)
+inline std::vector< size_t > defm_hash_arrays(
+  defm::DEFM & model,
+  const std::vector< size_t > & starts,
+  int ncores,
+  const std::vector< size_t > * parent = nullptr,
+  const double * X = nullptr,
+  size_t from = 0u
+) {
+
+  const size_t n_arrays = starts.size();
+  std::vector< std::vector< double > > keys(n_arrays);
+  DEFMSupportKeys keymap;
+  DEFMThreadError err;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    defm::DEFMArray array;
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t a = 0u; a < n_arrays; ++a)
+    {
+
+      try {
+
+        fill_array_window(model, array, starts[a], X);
+        if (parent == nullptr)
+          keys[a] = model.get_counters()->gen_hash(array);
+        else
+        {
+
+          keys[a].clear();
+          for (size_t j = from; j < model.nterms(); ++j)
+          {
+
+            auto & counter = (*model.get_counters())[j];
+            auto hasher    = counter.get_hasher();
+            if (!hasher)
+              continue;
+
+            const std::vector< double > h = hasher(array, &counter.data);
+            keys[a].insert(keys[a].end(), h.begin(), h.end());
+
+          }
+
+          keys[a].push_back(static_cast< double >((*parent)[a]));
+
+        }
+
+        keymap.claim(keys[a], a);
+
+      } catch (const std::exception & e) {
+        err.set(e);
+      }
+
+    }
+
+  }
+
+  err.rethrow();
+
+  std::vector< size_t > owner(n_arrays);
+  for (size_t a = 0u; a < n_arrays; ++a)
+    owner[a] = keymap.owner(keys[a]);
+
+  return owner;
+
+}
+
+// Enumerates the support of the window starting at row `start` with the
+// compiled terms: every possible last row (the model has no rules). The
+// rows are visited in Gray-code order, so each one differs from the
+// previous one in a single cell and only the terms involving that cell are
+// updated (see DEFMTermWalk.) They are stored in lexicographic order, so
+// they come out sorted.
+inline void defm_enumerate_program(
+  const DEFMTermProgram & prog,
+  const int * Y,
+  const double * X,
+  size_t nrows,
+  size_t start,
+  DEFMBitRows & rows,
+  std::vector< double > & stats
+) {
+
+  const size_t n_y = prog.n_y;
+  const size_t k   = prog.k;
+  const size_t n   = size_t(1u) << n_y;
+
+  // The window with the last row set to zero
+  std::vector< uint64_t > w(prog.nwords);
+  std::vector< int > cells(n_y, 0);
+  prog.pack_window(Y, nrows, start, w.data());
+  for (size_t y = 0u; y < n_y; ++y)
+    prog.set_cell(w.data(), prog.m_order, y, 0);
+
+  DEFMTermWalk walk(prog);
+  walk.reset(w.data(), X + start + prog.m_order, nrows);
+
+  rows = DEFMBitRows(n_y, n);
+  stats.resize(n * k);
+  for (size_t i = 0u; i < n; ++i)
+  {
+
+    // Step i flips bit ctz(i) of the Gray code i ^ (i >> 1), which is the
+    // position of the row in lexicographic order (the first outcome is the
+    // most significant bit)
+    if (i > 0u)
+    {
+      const size_t y = n_y - 1u - static_cast< size_t >(__builtin_ctzll(i));
+      cells[y] ^= 1;
+      walk.flip(y, cells[y]);
+    }
+
+    const size_t r = i ^ (i >> 1u);
+    rows.set_row(r, cells.data());
+    std::copy(walk.stats.begin(), walk.stats.end(), stats.begin() + r * k);
+
+  }
+
+}
+
+// defm_compile_checked() compares the program with barry's counters on a
+// sample of arrays only. Before the program replaces the counters in an
+// initialization, it is compared on the arrays in `starts` (e.g., the owners
+// of the supports) in two ways:
+//
+//  1. The observed window of every array, one count each.
+//  2. Every value of the cells a term has in the last row, for one array per
+//     pattern of the term: the values of its cells in the previous rows and
+//     whether its covariate is zero. A term's statistic only depends on
+//     those, so this covers every row of every support the term can see in
+//     the data (up to the value of the covariate, which 1. checks), not a
+//     sample. Terms with more than `max_cells` cells in the last row are
+//     checked on 2^max_cells pseudo-random values of them instead.
+//
+// The program holds the terms [from, from + prog.k) of the model, and `X`
+// overrides its covariates (see fill_array_window().)
+inline bool defm_check_program(
+  defm::DEFM & model,
+  const DEFMTermProgram & prog,
+  const std::vector< size_t > & starts,
+  const double * X,
+  int ncores,
+  size_t from = 0u,
+  size_t max_cells = 12u
+) {
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const size_t k       = prog.k;
+  const size_t nw      = prog.nwords;
+  const int * Y        = model.get_Y();
+  const double * Xp    = (X != nullptr) ? X : model.get_X();
+  const size_t n       = starts.size();
+
+  auto same = [](double a, double b) -> bool {
+    return std::fabs(a - b) <= 1e-10 * std::max(1.0, std::fabs(b));
+  };
+
+  // One array per pattern of each term (term, previous rows, covariate)
+  std::vector< std::vector< uint64_t > > hist(k, std::vector< uint64_t >(nw));
+  std::vector< std::vector< size_t > > last_cells(k);
+  for (size_t j = 0u; j < k; ++j)
+  {
+
+    std::copy(&prog.mask[j * nw], &prog.mask[j * nw] + nw, hist[j].begin());
+    for (size_t y = 0u; y < n_y; ++y)
+    {
+
+      if (!prog.in_term(j, m_order, y))
+        continue;
+
+      last_cells[j].push_back(y);
+      prog.set_cell(hist[j].data(), m_order, y, 0);
+
+    }
+
+  }
+
+  std::map< std::vector< uint64_t >, size_t > patterns;
+  std::vector< std::pair< size_t, size_t > > checks;  // (term, start)
+  std::vector< uint64_t > w(nw), key(nw + 2u);
+  for (size_t i = 0u; i < n; ++i)
+  {
+
+    prog.pack_window(Y, nrows, starts[i], w.data());
+    for (size_t j = 0u; j < k; ++j)
+    {
+
+      key[0u] = j;
+      for (size_t l = 0u; l < nw; ++l)
+        key[l + 1u] = w[l] & hist[j][l];
+
+      key[nw + 1u] = (prog.covar[j] >= 0) && (Xp[
+        static_cast< size_t >(prog.covar[j]) * nrows + starts[i] + m_order
+      ] == 0.0);
+
+      if (patterns.emplace(key, i).second)
+        checks.emplace_back(j, starts[i]);
+
+    }
+
+  }
+
+  const size_t nchecks = checks.size();
+  bool ok = true;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores) reduction(&&:ok)
+  #endif
+  {
+
+    defm::DEFMArray array;
+    defm::DEFMStatsCounter counter;
+    for (size_t j = from; j < (from + k); ++j)
+      counter.add_counter((*model.get_counters())[j]);
+
+    std::vector< uint64_t > w(nw);
+    std::vector< double > stats(k);
+
+    // Step 1: the observed window of every array
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t i = 0u; i < n; ++i)
+    {
+
+      if (!ok)
+        continue;
+
+      try {
+
+        const size_t start = starts[i];
+        fill_array_window(model, array, start, X);
+        for (size_t y = 0u; y < n_y; ++y)
+          array(m_order, y) = Y[y * nrows + start + m_order];
+
+        counter.reset_array(&array);
+        const std::vector< double > expected = counter.count_all();
+
+        prog.pack_window(Y, nrows, start, w.data());
+        prog.eval(w.data(), Xp + start + m_order, nrows, stats.data());
+
+        if (expected.size() != k)
+          ok = false;
+
+        for (size_t j = 0u; ok && (j < k); ++j)
+          ok = same(stats[j], expected[j]);
+
+      } catch (...) {
+        ok = false;
+      }
+
+    }
+
+    // Step 2: every value of the last-row cells of each term, one array per
+    // pattern (counting only that term)
+    std::vector< defm::DEFMStatsCounter > single(k);
+    for (size_t j = 0u; j < k; ++j)
+      single[j].add_counter((*model.get_counters())[from + j]);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for (size_t c = 0u; c < nchecks; ++c)
+    {
+
+      if (!ok)
+        continue;
+
+      try {
+
+        const size_t j     = checks[c].first;
+        const size_t start = checks[c].second;
+        const auto & cells = last_cells[j];
+        const size_t nc    = cells.size();
+        const bool all     = nc <= max_cells;
+        const size_t nv    = size_t(1u) << (all ? nc : max_cells);
+
+        // The other cells of the last row keep their observed values
+        fill_array_window(model, array, start, X);
+        for (size_t y = 0u; y < n_y; ++y)
+          array(m_order, y) = Y[y * nrows + start + m_order];
+
+        prog.pack_window(Y, nrows, start, w.data());
+
+        for (size_t v = 0u; ok && (v < nv); ++v)
+        {
+
+          uint64_t h = v * 0x9E3779B97F4A7C15ULL + start;
+          for (size_t l = 0u; l < nc; ++l)
+          {
+
+            if (!all && ((l % 64u) == 0u))
+              h = (h ^ (h >> 31)) * 0xBF58476D1CE4E5B9ULL + l;
+
+            const int v_l = static_cast< int >(
+              all ? ((v >> l) & 1u) : ((h >> (l % 64u)) & 1u)
+            );
+
+            array(m_order, cells[l]) = v_l;
+            prog.set_cell(w.data(), m_order, cells[l], v_l);
+
+          }
+
+          single[j].reset_array(&array);
+          const std::vector< double > expected = single[j].count_all();
+          prog.eval(w.data(), Xp + start + m_order, nrows, stats.data());
+
+          ok = (expected.size() == 1u) && same(stats[j], expected[0u]);
+
+        }
+
+      } catch (...) {
+        ok = false;
+      }
+
+    }
+
+  }
+
+  return ok;
+
+}
+
+// Same as defm_enumerate_program(), but for models with rules described in
+// the program: cells of absorbing outcomes that were one in the previous
+// row are fixed at one, and the free cells are set one at a time (depth
+// first, zero before one, so the rows come out sorted.) At each step, the
+// bounded statistics are bracketed given the cells still free; if a bound
+// cannot be met, the whole subtree is skipped. So the cost grows with the
+// size of the support instead of 2^n_y.
+class DEFMPrunedEnumerator {
+private:
+
+  const DEFMTermProgram & prog;
+  DEFMTermWalk walk;
+  std::vector< int > cells;
+  std::vector< size_t > free;
+
+  // Free cells from depth d on in the term of each bound: all of them
+  // (left_any) and those the motif expects to be one (left_ones), which
+  // count as mismatches while they are zero.
+  std::vector< int > left_any;
+  std::vector< int > left_ones;
+
+  DEFMBitRows & rows;
+  std::vector< double > & stats;
+
+  bool feasible(size_t d) const {
+
+    const size_t nb = prog.bounds.size();
+    for (size_t b = 0u; b < nb; ++b)
+    {
+
+      const size_t j   = prog.bounds[b].term;
+      const int n      = walk.count(j);
+      const int any    = left_any[d * nb + b];
+
+      double lo, hi;
+      if (prog.motif[j])
+      {
+
+        const bool broken = (n - left_ones[d * nb + b]) > 0;
+        lo = (broken || (any > 0)) ? 0.0 : static_cast< double >(n == 0);
+        hi = broken ? 0.0 : 1.0;
+
+      } else {
+
+        lo = static_cast< double >(n);
+        hi = static_cast< double >(n + any);
+
+      }
+
+      if (prog.covar[j] >= 0)
+      {
+        lo *= walk.weight(j);
+        hi *= walk.weight(j);
+        if (lo > hi)
+          std::swap(lo, hi);
+      }
+
+      if ((hi < prog.bounds[b].lb) || (lo > prog.bounds[b].ub))
+        return false;
+
+    }
+
+    return true;
+
+  };
+
+  void visit(size_t d) {
+
+    if (!feasible(d))
+      return;
+
+    if (d == free.size())
+    {
+      rows.push_back(cells.data());
+      stats.insert(stats.end(), walk.stats.begin(), walk.stats.end());
+      return;
+    }
+
+    const size_t y = free[d];
+    visit(d + 1u);
+
+    cells[y] = 1;
+    walk.flip(y, 1);
+    visit(d + 1u);
+
+    cells[y] = 0;
+    walk.flip(y, 0);
+
+  };
+
+public:
+
+  DEFMPrunedEnumerator(
+    const DEFMTermProgram & prog_,
+    DEFMBitRows & rows_,
+    std::vector< double > & stats_
+  ) : prog(prog_), walk(prog_), rows(rows_), stats(stats_) {};
+
+  void run(
+    const int * Y,
+    const double * X,
+    size_t nrows,
+    size_t start
+  ) {
+
+    const size_t n_y     = prog.n_y;
+    const size_t m_order = prog.m_order;
+    const size_t nb      = prog.bounds.size();
+
+    std::vector< uint64_t > w(prog.nwords);
+    prog.pack_window(Y, nrows, start, w.data());
+
+    cells.assign(n_y, 0);
+    free.clear();
+    for (size_t y = 0u; y < n_y; ++y)
+    {
+
+      const bool fixed = (m_order > 0u) && prog.absorbing[y] &&
+        (Y[y * nrows + start + m_order - 1u] != 0);
+
+      cells[y] = fixed ? 1 : 0;
+      prog.set_cell(w.data(), m_order, y, cells[y]);
+      if (!fixed)
+        free.push_back(y);
+
+    }
+
+    const size_t nf = free.size();
+    left_any.assign((nf + 1u) * nb, 0);
+    left_ones.assign((nf + 1u) * nb, 0);
+    for (size_t d = nf; d-- > 0u;)
+      for (size_t b = 0u; b < nb; ++b)
+      {
+
+        const size_t j = prog.bounds[b].term;
+        const bool in  = prog.in_term(j, m_order, free[d]);
+
+        left_any[d * nb + b]  = left_any[(d + 1u) * nb + b] + in;
+        left_ones[d * nb + b] = left_ones[(d + 1u) * nb + b] +
+          (in && prog.motif[j] && prog.sign(j, m_order, free[d]));
+
+      }
+
+    walk.reset(w.data(), X + start + m_order, nrows);
+
+    rows = DEFMBitRows(n_y);
+    stats.clear();
+    visit(0u);
+
+  };
+
+};
+
+// barry's rules are closures too, so the rules described in the program
+// are checked against the model's support function: the same rows, with
+// the same statistics. What the rules keep of a support only depends on the
+// previous row of the absorbing outcomes and, for each bounded term, on its
+// cells in the previous rows and its covariate; so one support (in `starts`)
+// per distinct pattern of those is compared in full, which covers every
+// support of the data.
+inline bool defm_check_rules(
+  defm::DEFM & model,
+  const DEFMTermProgram & prog,
+  const std::vector< size_t > & starts,
+  const double * X,
+  int ncores
+) {
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const size_t k       = prog.k;
+  const size_t nw      = prog.nwords;
+  const int * Y        = model.get_Y();
+  const double * Xp    = (X != nullptr) ? X : model.get_X();
+
+  // The previous rows of each bounded term
+  const size_t nb = prog.bounds.size();
+  std::vector< std::vector< uint64_t > > hist(nb);
+  for (size_t b = 0u; b < nb; ++b)
+  {
+
+    const size_t j = prog.bounds[b].term;
+    hist[b].assign(&prog.mask[j * nw], &prog.mask[j * nw] + nw);
+    for (size_t y = 0u; y < n_y; ++y)
+      prog.set_cell(hist[b].data(), m_order, y, 0);
+
+  }
+
+  // One support per pattern (the covariates are stored bit for bit)
+  std::map< std::vector< uint64_t >, size_t > patterns;
+  std::vector< size_t > sample;
+  std::vector< uint64_t > w(nw), key;
+  for (const auto & start : starts)
+  {
+
+    key.clear();
+    for (size_t y = 0u; (m_order > 0u) && (y < n_y); ++y)
+      if (prog.absorbing[y])
+        key.push_back(Y[y * nrows + start + m_order - 1u] != 0);
+
+    prog.pack_window(Y, nrows, start, w.data());
+    for (size_t b = 0u; b < nb; ++b)
+    {
+
+      for (size_t l = 0u; l < nw; ++l)
+        key.push_back(w[l] & hist[b][l]);
+
+      const int covar = prog.covar[prog.bounds[b].term];
+      if (covar >= 0)
+      {
+        uint64_t x;
+        const double xval = Xp[
+          static_cast< size_t >(covar) * nrows + start + m_order
+        ];
+        std::memcpy(&x, &xval, sizeof(x));
+        key.push_back(x);
+      }
+
+    }
+
+    if (patterns.emplace(key, start).second)
+      sample.push_back(start);
+
+  }
+
+  const size_t nsample = sample.size();
+  bool ok = true;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores) reduction(&&:ok)
+  #endif
+  {
+
+    auto support = *model.get_support_fun();
+    defm::DEFMArray array;
+    std::vector< defm::DEFMArray > arrays;
+    std::vector< double > stats, pstats;
+    std::vector< uint64_t > bits((n_y + 63u) / 64u);
+    std::vector< int > cells(n_y);
+    DEFMBitRows prows;
+
+    DEFMPrunedEnumerator pruned(prog, prows, pstats);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for (size_t s = 0u; s < nsample; ++s)
+    {
+
+      if (!ok)
+        continue;
+
+      try {
+
+        const size_t start = sample[s];
+        fill_array_window(model, array, start, X);
+        arrays.clear();
+        stats.clear();
+        support.reset_array(array);
+        support.calc(&arrays, &stats);
+
+        pruned.run(Y, Xp, nrows, start);
+
+        if (
+          (arrays.size() != prows.size()) || (stats.size() != pstats.size())
+        )
+        {
+          ok = false;
+          continue;
+        }
+
+        for (size_t i = 0u; ok && (i < arrays.size()); ++i)
+        {
+
+          for (size_t y = 0u; y < n_y; ++y)
+            cells[y] = arrays[i].get_cell(m_order, y, false);
+
+          DEFMBitRows::pack(cells.data(), n_y, bits.data());
+          const size_t loc = prows.find(bits.data());
+          if (loc == prows.size())
+          {
+            ok = false;
+            break;
+          }
+
+          for (size_t j = 0u; ok && (j < k); ++j)
+          {
+
+            const double a = stats[i * k + j], b = pstats[loc * k + j];
+            ok = std::fabs(a - b) <= 1e-10 * std::max(1.0, std::fabs(a));
+
+          }
+
+        }
+
+      } catch (...) {
+        ok = false;
+      }
+
+    }
+
+  }
+
+  return ok;
+
+}
+
+// Numbers the supports in order of first appearance given the owner of each
+// array. Fills `arrays2support` and `owners` (first array of each support).
+inline void defm_number_supports(
+  const std::vector< size_t > & owner,
+  std::vector< size_t > & arrays2support,
+  std::vector< size_t > & owners
+) {
+
+  const size_t n_arrays = owner.size();
+
+  std::vector< size_t > support_of_owner(n_arrays, 0u);
+  arrays2support.resize(n_arrays);
+  owners.clear();
+
+  for (size_t a = 0u; a < n_arrays; ++a)
+  {
+
+    if (owner[a] == a)
+    {
+      support_of_owner[a] = owners.size();
+      owners.push_back(a);
+    }
+
+    arrays2support[a] = support_of_owner[owner[a]];
+
+  }
+
+}
+
+// Initializes the model natively (init_defm() with any number of threads.)
+// This does what DEFM::init() does, but splitting the work across `ncores`
+// threads (one is fine):
+//
+//  1. Each array (window of m_order + 1 rows) is hashed with the model's
+//     counters, and its key is claimed in a concurrent map.
+//  2. Unique supports are numbered in order of first appearance (so the
+//     result matches the serial order) and enumerated, once each, using a
+//     thread-local copy of the model's support function (or the compiled
+//     terms in `store.program`, if the model has no rules or they are
+//     described in the program, see DEFMPrunedEnumerator.)
+//  3. The observed statistics of each array are read off its support.
+//
+// `check_interrupt` is called by the main thread between steps. If
+// `profile` is not null, the time spent in each step is added to it. `X`
+// overrides the model's covariates (see defm_init_factored().)
+template< typename Interrupt >
+inline void defm_init_parallel(
+  defm::DEFM & model,
+  DEFMSupportStore & store,
+  bool force_new,
+  int ncores,
+  Interrupt check_interrupt,
+  DEFMProfile * profile = nullptr,
+  const double * X = nullptr
+) {
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const size_t k       = model.nterms();
+  const int * Y        = model.get_Y();
+
+  store.k          = k;
+  store.ncores     = ncores;
+  store.factored   = false;
+  store.covar_bins = 0;
+
+  // Where does each array start?
+  std::vector< int > rows;
+  rows2arrays(model, 0u, nrows, rows);
+
+  store.starts.clear();
+  for (size_t i = 0u; i < nrows; ++i)
+    if (rows[i] >= 0)
+      store.starts.push_back(i - m_order);
+
+  const size_t n_arrays = store.starts.size();
+
+  // Step 1: Hashing and deduplicating ----------------------------------------
+  DEFMTimer timer_hash(profile ? &profile->time_hash : nullptr);
+
+  std::vector< size_t > owner(n_arrays);
+  if (force_new)
+  {
+    for (size_t a = 0u; a < n_arrays; ++a)
+      owner[a] = a;
+  } else
+    owner = defm_hash_arrays(model, store.starts, ncores, nullptr, X);
+
+  check_interrupt();
+
+  defm_number_supports(owner, store.arrays2support, store.owners);
+
+  const size_t n_support = store.owners.size();
+
+  timer_hash.stop();
+
+  // Step 2: Enumerating each unique support ----------------------------------
+  DEFMTimer timer_enumerate(profile ? &profile->time_enumerate : nullptr);
+
+  // For each support, the possible last rows (sorted, for lookups) and their
+  // statistics.
+  store.rows.assign(n_support, DEFMBitRows(n_y));
+  store.stats.assign(n_support, std::vector< double >());
+
+  // The compiled terms enumerate the supports if the model has no rules,
+  // or if its rules are described in the program and agree with barry's.
+  const double * X_prog = (X != nullptr) ? X : model.get_X();
+  std::vector< size_t > owner_starts(n_support);
+  for (size_t s = 0u; s < n_support; ++s)
+    owner_starts[s] = store.starts[store.owners[s]];
+
+  const DEFMTermProgram & prog = store.program;
+  const bool compiled = prog.compiled() && (prog.k == k) && (n_y < 32u) &&
+    (
+      prog.free_support ||
+      (
+        prog.rules_known &&
+        defm_check_rules(model, prog, owner_starts, X, ncores)
+      )
+    ) && defm_check_program(model, prog, owner_starts, X, ncores);
+
+  DEFMThreadError err;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    auto support = *model.get_support_fun();
+    defm::DEFMArray array;
+
+    std::vector< defm::DEFMArray > arrays;
+    std::vector< double > stats;
+    std::vector< size_t > ord;
+    std::vector< int > cells(n_y);
+
+    DEFMBitRows prows;
+    std::vector< double > pstats;
+    DEFMPrunedEnumerator pruned(prog, prows, pstats);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for (size_t s = 0u; s < n_support; ++s)
+    {
+
+      try {
+
+        if (compiled && prog.free_support)
+        {
+
+          defm_enumerate_program(
+            prog, Y, X_prog, nrows, owner_starts[s],
+            store.rows[s], store.stats[s]
+          );
+
+          continue;
+
+        } else if (compiled)
+        {
+
+          pruned.run(Y, X_prog, nrows, owner_starts[s]);
+          store.rows[s]  = std::move(prows);
+          store.stats[s] = std::move(pstats);
+
+          if (store.rows[s].size() == 0u)
+            throw std::logic_error("The support of the array is empty.");
+
+          continue;
+
+        }
+
+        fill_array_window(model, array, store.starts[store.owners[s]], X);
+
+        arrays.clear();
+        stats.clear();
+        support.reset_array(array);
+        support.calc(&arrays, &stats);
+
+        size_t n = arrays.size();
+        if ((n == 0u) || (stats.size() != (n * k)))
+          throw std::logic_error(
+            "The support of the array is empty or does not match the number of terms."
+          );
+
+        DEFMBitRows r(n_y, n);
+        for (size_t i = 0u; i < n; ++i)
+        {
+          for (size_t y = 0u; y < n_y; ++y)
+            cells[y] = arrays[i].get_cell(m_order, y, false);
+          r.set_row(i, cells.data());
+        }
+
+        // Sorting the rows (lexicographically) to find them by bisection
+        ord.resize(n);
+        for (size_t i = 0u; i < n; ++i)
+          ord[i] = i;
+
+        const size_t nw = r.words();
+        std::sort(ord.begin(), ord.end(), [&](size_t i, size_t j) {
+          return std::lexicographical_compare(
+            r.row(i), r.row(i) + nw, r.row(j), r.row(j) + nw
+          );
+        });
+
+        store.rows[s].resize(n);
+        store.stats[s].resize(n * k);
+        for (size_t i = 0u; i < n; ++i)
+        {
+
+          store.rows[s].copy_row(i, r, ord[i]);
+
+          std::copy(
+            stats.begin() + ord[i] * k, stats.begin() + (ord[i] + 1u) * k,
+            store.stats[s].begin() + i * k
+          );
+
+        }
+
+      } catch (const std::exception & e) {
+        err.set(e);
+      }
+
+    }
+
+  }
+
+  err.rethrow();
+  timer_enumerate.stop();
+  check_interrupt();
+
+  if (profile != nullptr)
+  {
+    if (!compiled)
+      profile->n_enum_barry += n_support;
+    else if (prog.free_support)
+      profile->n_enum_gray += n_support;
+    else
+      profile->n_enum_pruned += n_support;
+  }
+
+  // Step 3: Observed statistics ----------------------------------------------
+  DEFMTimer timer_stats(profile ? &profile->time_stats : nullptr);
+
+  store.target.resize(n_arrays * k);
+  store.target_loc.resize(n_arrays);
+
+  #ifdef _OPENMP
+  #pragma omp parallel for num_threads(ncores) schedule(static)
+  #endif
+  for (size_t a = 0u; a < n_arrays; ++a)
+  {
+
+    const size_t s    = store.arrays2support[a];
+    const auto & sr   = store.rows[s];
+    const size_t last = store.starts[a] + m_order;
+
+    // Bisection over the sorted rows
+    std::vector< uint64_t > row(sr.words());
+    DEFMBitRows::pack(Y + last, n_y, row.data(), nrows);
+
+    const size_t lo = sr.find(row.data());
+    if (lo == sr.size())
+    {
+      err.set(std::logic_error(
+        "The observed data in row " + std::to_string(last + 1u) +
+        " is not part of its support (does it violate the model's rules?)"
+      ));
+      continue;
+    }
+
+    store.target_loc[a] = lo;
+    std::copy(
+      store.stats[s].begin() + lo * k, store.stats[s].begin() + (lo + 1u) * k,
+      store.target.begin() + a * k
+    );
+
+  }
+
+  err.rethrow();
+
+  store.collapse();
+
+}
+
+// Initializes the model factoring the covariates out of the supports. For
+// terms weighted by a covariate (e.g., td_logit_intercept(m, covar = "x")
+// or "{y0} x x"), the statistic of an array is a base statistic times the
+// covariate of the array, so arrays that only differ in the covariates
+// share the same base support:
+//
+//  1. The model is initialized as in defm_init_parallel(), but with all the
+//     covariates set to one, so each base support is enumerated once.
+//  2. For each array, the multiplier of each term is read off one row of
+//     its base support (the first one where the base statistic is not zero)
+//     by counting the terms with the actual covariates (with the compiled
+//     terms, if available.) The observed statistics are counted the same
+//     way, and must match the multipliers.
+//  3. The full support of `nvalidate` arrays (evenly spaced) is enumerated
+//     with the actual covariates and compared with the factored one. Terms
+//     that are not a statistic times a covariate fail here.
+//
+// Arrays sharing a base support and multipliers are grouped, so the
+// likelihood is evaluated once per group (see DEFMLikelihood::scale.)
+template< typename Interrupt >
+inline void defm_init_factored(
+  defm::DEFM & model,
+  DEFMSupportStore & store,
+  int ncores,
+  Interrupt check_interrupt,
+  DEFMProfile * profile = nullptr,
+  size_t nvalidate = 32u
+) {
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const size_t k       = model.nterms();
+  const int * Y        = model.get_Y();
+
+  // Step 1: Base supports ----------------------------------------------------
+  std::vector< double > ones(nrows * model.get_n_covars(), 1.0);
+  defm_init_parallel(
+    model, store, false, ncores, check_interrupt, profile,
+    ones.size() > 0u ? ones.data() : nullptr
+  );
+
+  ncores = store.ncores;
+
+  DEFMTimer timer(profile ? &profile->time_stats : nullptr);
+
+  const size_t n_arrays  = store.n_arrays();
+  const size_t n_support = store.n_support();
+  const std::vector< std::string > & terms = model.colnames();
+
+  // Rows of each support used to read the multipliers: probes[s] lists
+  // them, and probe[s * k + j] is the position in that list used for term
+  // j (or -1 if the base statistic is zero everywhere.)
+  std::vector< std::vector< size_t > > probes(n_support);
+  std::vector< int > probe(n_support * k, -1);
+  for (size_t s = 0u; s < n_support; ++s)
+  {
+
+    const auto & st = store.stats[s];
+    const size_t n  = st.size() / k;
+
+    for (size_t j = 0u; j < k; ++j)
+      for (size_t i = 0u; i < n; ++i)
+      {
+
+        if (st[i * k + j] == 0.0)
+          continue;
+
+        auto loc = std::find(probes[s].begin(), probes[s].end(), i);
+        probe[s * k + j] = static_cast< int >(loc - probes[s].begin());
+        if (loc == probes[s].end())
+          probes[s].push_back(i);
+
+        break;
+
+      }
+
+  }
+
+  // Step 2: Multipliers and observed statistics ------------------------------
+  std::vector< double > scale(n_arrays * k, 1.0);
+  DEFMThreadError err;
+
+  auto mismatch = [&terms](size_t j, size_t row) -> std::logic_error {
+    return std::logic_error(
+      "The term \"" + terms[j] + "\" is not a statistic times a covariate " +
+      "(row " + std::to_string(row + 1u) + "), so it cannot be factored. " +
+      "Use init_defm(factor_covar = FALSE)."
+    );
+  };
+
+  auto changed = [](size_t row) -> std::logic_error {
+    return std::logic_error(
+      "The support of row " + std::to_string(row + 1u) + " depends on the " +
+      "covariates (through a rule?), so it cannot be factored. " +
+      "Use init_defm(factor_covar = FALSE)."
+    );
+  };
+
+  auto same = [](double a, double b) -> bool {
+    return std::fabs(a - b) <= 1e-8 * std::max(1.0, std::fabs(a));
+  };
+
+  // Counting with the compiled terms, if available (and they agree with
+  // barry's counters on the owners of the supports)
+  std::vector< size_t > owner_starts(n_support);
+  for (size_t s = 0u; s < n_support; ++s)
+    owner_starts[s] = store.starts[store.owners[s]];
+
+  const DEFMTermProgram & prog = store.program;
+  const bool compiled = prog.compiled() && (prog.k == k) &&
+    defm_check_program(model, prog, owner_starts, nullptr, ncores);
+  const double * X    = model.get_X();
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    defm::DEFMArray array;
+    defm::DEFMStatsCounter counter;
+    for (size_t j = 0u; j < k; ++j)
+      counter.add_counter((*model.get_counters())[j]);
+
+    std::vector< std::vector< double > > counts;
+    std::vector< double > obs;
+    std::vector< int > cells(n_y);
+    std::vector< uint64_t > w(prog.nwords);
+    const double * x = nullptr;
+
+    // Statistics of the current window with `cells` as its last row
+    auto count = [&](std::vector< double > & out) -> void {
+
+      if (compiled)
+      {
+
+        for (size_t y = 0u; y < n_y; ++y)
+          prog.set_cell(w.data(), m_order, y, cells[y]);
+
+        out.resize(k);
+        prog.eval(w.data(), x, nrows, out.data());
+        return;
+
+      }
+
+      for (size_t y = 0u; y < n_y; ++y)
+        array(m_order, y) = cells[y];
+
+      counter.reset_array(&array);
+      out = counter.count_all();
+
+    };
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t a = 0u; a < n_arrays; ++a)
+    {
+
+      try {
+
+        const size_t s    = store.arrays2support[a];
+        const auto & sr   = store.rows[s];
+        const auto & st   = store.stats[s];
+        const size_t last = store.starts[a] + m_order;
+
+        if (compiled)
+        {
+          prog.pack_window(Y, nrows, store.starts[a], w.data());
+          x = X + last;
+        } else
+          fill_array_window(model, array, store.starts[a]);
+
+        counts.resize(probes[s].size());
+        for (size_t p = 0u; p < probes[s].size(); ++p)
+        {
+
+          for (size_t y = 0u; y < n_y; ++y)
+            cells[y] = sr.get(probes[s][p], y);
+
+          count(counts[p]);
+
+        }
+
+        for (size_t j = 0u; j < k; ++j)
+        {
+
+          const int p = probe[s * k + j];
+          if (p < 0)
+            continue;
+
+          scale[a * k + j] = counts[p][j] / st[probes[s][p] * k + j];
+
+        }
+
+        // Observed statistics, which must match the factored ones
+        for (size_t y = 0u; y < n_y; ++y)
+          cells[y] = Y[y * nrows + last];
+
+        count(obs);
+
+        const size_t loc = store.target_loc[a];
+        for (size_t j = 0u; j < k; ++j)
+        {
+
+          if (!same(obs[j], scale[a * k + j] * st[loc * k + j]))
+            throw mismatch(j, last);
+
+          store.target[a * k + j] = obs[j];
+
+        }
+
+      } catch (const std::exception & e) {
+        err.set(e);
+      }
+
+    }
+
+  }
+
+  err.rethrow();
+  check_interrupt();
+
+  // Step 3: Validating the full support of a few arrays ----------------------
+  nvalidate = std::min(nvalidate, n_arrays);
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    auto support = *model.get_support_fun();
+    defm::DEFMArray array;
+    std::vector< defm::DEFMArray > arrays;
+    std::vector< double > stats;
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for (size_t v = 0u; v < nvalidate; ++v)
+    {
+
+      try {
+
+        const size_t a = (nvalidate > 1u) ?
+          v * (n_arrays - 1u) / (nvalidate - 1u) : 0u;
+        const size_t s = store.arrays2support[a];
+        const auto & sr = store.rows[s];
+        const auto & st = store.stats[s];
+        const size_t n  = sr.size();
+
+        fill_array_window(model, array, store.starts[a]);
+
+        arrays.clear();
+        stats.clear();
+        support.reset_array(array);
+        support.calc(&arrays, &stats);
+
+        if (arrays.size() != n)
+          throw changed(store.starts[a] + m_order);
+
+        std::vector< int > cells(n_y);
+        std::vector< uint64_t > r(sr.words());
+        for (size_t i = 0u; i < n; ++i)
+        {
+
+          for (size_t y = 0u; y < n_y; ++y)
+            cells[y] = arrays[i].get_cell(m_order, y, false);
+
+          // Locating the row in the (sorted) base support
+          DEFMBitRows::pack(cells.data(), n_y, r.data());
+          const size_t lo = sr.find(r.data());
+
+          if (lo == n)
+            throw changed(store.starts[a] + m_order);
+
+          for (size_t j = 0u; j < k; ++j)
+            if (!same(stats[i * k + j], scale[a * k + j] * st[lo * k + j]))
+              throw mismatch(j, store.starts[a] + m_order);
+
+        }
+
+      } catch (const std::exception & e) {
+        err.set(e);
+      }
+
+    }
+
+  }
+
+  err.rethrow();
+
+  // Grouping arrays by support and multipliers
+  std::map< std::vector< double >, size_t > groups;
+  std::vector< double > key(k + 1u);
+
+  store.group_support.clear();
+  store.group_scale.clear();
+  store.group_narrays.clear();
+  store.arrays2group.resize(n_arrays);
+
+  for (size_t a = 0u; a < n_arrays; ++a)
+  {
+
+    key[0u] = static_cast< double >(store.arrays2support[a]);
+    std::copy(&scale[a * k], &scale[a * k] + k, key.begin() + 1u);
+
+    auto res = groups.emplace(key, store.group_support.size());
+    if (res.second)
+    {
+      store.group_support.push_back(store.arrays2support[a]);
+      store.group_scale.insert(
+        store.group_scale.end(), key.begin() + 1u, key.end()
+      );
+      store.group_narrays.push_back(0.0);
+    }
+
+    store.group_narrays[res.first->second] += 1.0;
+    store.arrays2group[a] = res.first->second;
+
+  }
+
+  store.factored = true;
+
+}
+
+// Updates a store after terms were added to the model. The supports (the
+// possible last rows) do not change, only their statistics: for each
+// support, the new columns are computed by counting the new terms on each
+// possible array, so the cost is one pass over the supports per term,
+// instead of enumerating them again.
+//
+// The arrays are hashed again with the new counters: if a new term
+// distinguishes arrays that shared a support (e.g., through a covariate),
+// that support is split. New counters without a hasher cannot split a
+// support, so if none has one the partition is kept as is. The old columns are the same for all the arrays
+// in a support (that is what sharing a support means), so they are copied.
+// If `store.program` has all the terms (the caller compiles it again after
+// adding them), the new columns are computed with it.
+template< typename Interrupt >
+inline void defm_extend_terms(
+  defm::DEFM & model,
+  DEFMSupportStore & store,
+  Interrupt check_interrupt
+) {
+
+  const size_t k_old   = store.k;
+  const size_t k       = model.nterms();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const size_t n_new   = k - k_old;
+  const size_t n_arrays = store.n_arrays();
+  int ncores           = store.ncores;
+
+  if (k < k_old)
+    throw std::logic_error(
+      "The model has fewer terms than when it was initialized."
+    );
+
+  if (n_new == 0u)
+    return;
+
+  // Did the new terms change the partition of the arrays?
+  bool hashed = false;
+  for (size_t j = k_old; j < k; ++j)
+    if ((*model.get_counters())[j].get_hasher())
+      hashed = true;
+
+  std::vector< size_t > arrays2support, owners;
+  if (hashed)
+  {
+
+    std::vector< size_t > owner = defm_hash_arrays(
+      model, store.starts, ncores, &store.arrays2support, nullptr, k_old
+    );
+
+    check_interrupt();
+    defm_number_supports(owner, arrays2support, owners);
+
+  } else {
+    arrays2support = store.arrays2support;
+    owners         = store.owners;
+  }
+
+  const size_t n_support = owners.size();
+
+  // Counting the new terms on every possible array of every support (with
+  // the compiled terms, if available and they agree with barry's counters
+  // on the owners of the supports)
+  std::vector< size_t > owner_starts(n_support);
+  for (size_t s = 0u; s < n_support; ++s)
+    owner_starts[s] = store.starts[owners[s]];
+
+  DEFMTermProgram prog;
+  if (store.program.compiled() && (store.program.k == k))
+    prog = store.program.subset(k_old, k);
+
+  const bool compiled = prog.compiled() &&
+    defm_check_program(model, prog, owner_starts, nullptr, ncores, k_old);
+
+  const size_t nrows = model.get_n_rows();
+  const int * Y      = model.get_Y();
+  const double * X   = model.get_X();
+
+  std::vector< DEFMBitRows > rows(n_support);
+  std::vector< std::vector< double > > stats(n_support);
+
+  DEFMThreadError err;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    defm::DEFMArray array;
+    defm::DEFMStatsCounter counter;
+    for (size_t j = k_old; j < k; ++j)
+      counter.add_counter((*model.get_counters())[j]);
+
+    std::vector< uint64_t > w(prog.nwords);
+    std::vector< double > res(n_new);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for (size_t s = 0u; s < n_support; ++s)
+    {
+
+      try {
+
+        const size_t a      = owners[s];
+        const size_t parent = store.arrays2support[a];
+        const auto & prows  = store.rows[parent];
+        const auto & pstats = store.stats[parent];
+        const size_t n      = prows.size();
+        const size_t last   = store.starts[a] + m_order;
+
+        if (compiled)
+          prog.pack_window(Y, nrows, store.starts[a], w.data());
+        else
+          fill_array_window(model, array, store.starts[a]);
+
+        rows[s] = prows;
+        stats[s].resize(n * k);
+
+        for (size_t i = 0u; i < n; ++i)
+        {
+
+          std::copy(
+            pstats.begin() + i * k_old, pstats.begin() + (i + 1u) * k_old,
+            stats[s].begin() + i * k
+          );
+
+          if (compiled)
+          {
+
+            for (size_t y = 0u; y < n_y; ++y)
+              prog.set_cell(w.data(), m_order, y, prows.get(i, y));
+
+            prog.eval(w.data(), X + last, nrows, res.data());
+
+          } else {
+
+            for (size_t y = 0u; y < n_y; ++y)
+              array(m_order, y) = prows.get(i, y);
+
+            counter.reset_array(&array);
+            res = counter.count_all();
+
+            if (res.size() != n_new)
+              throw std::logic_error(
+                "The number of new statistics does not match the number of new terms."
+              );
+
+          }
+
+          std::copy(res.begin(), res.end(), stats[s].begin() + i * k + k_old);
+
+        }
+
+      } catch (const std::exception & e) {
+        err.set(e);
+      }
+
+    }
+
+  }
+
+  err.rethrow();
+  check_interrupt();
+
+  // Observed statistics: same location within the (possibly split) support
+  std::vector< double > target(n_arrays * k);
+  for (size_t a = 0u; a < n_arrays; ++a)
+  {
+
+    const size_t s   = arrays2support[a];
+    const size_t loc = store.target_loc[a];
+
+    std::copy(
+      stats[s].begin() + loc * k, stats[s].begin() + (loc + 1u) * k,
+      target.begin() + a * k
+    );
+
+  }
+
+  store.k = k;
+  store.target.swap(target);
+  store.arrays2support.swap(arrays2support);
+  store.owners.swap(owners);
+  store.rows.swap(rows);
+  store.stats.swap(stats);
+  store.collapse();
+
+}
+
+#endif
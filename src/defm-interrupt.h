@@ -0,0 +1,30 @@
+#ifndef DEFM_INTERRUPT_H
+#define DEFM_INTERRUPT_H
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Checks for user interrupts from R. The check throws a C++ exception, which
+// must not cross the boundary of an OpenMP region, and calls into R, which
+// is not thread-safe; so, inside parallel regions (active or not), it is a
+// no-op and the check is left to the main thread once the region is done.
+inline void defm_check_interrupt()
+{
+
+  #ifdef _OPENMP
+  if (omp_get_level() > 0)
+    return;
+  #endif
+
+  Rcpp::checkUserInterrupt();
+
+}
+
+#ifdef BARRY_USER_INTERRUPT
+#undef BARRY_USER_INTERRUPT
+#endif
+
+#define BARRY_USER_INTERRUPT defm_check_interrupt();
+
+#endif
@@ -0,0 +1,140 @@
+#include <Rcpp.h>
+
+// Lets barry check for user interrupts (Ctrl-C) during long-running
+// computations such as the support enumeration in init_defm().
+#include "defm-interrupt.h"
+
+#include <barry/barry.hpp>
+#include <barry/models/defm.hpp>
+#include "defm-common.h"
+#include "defm-io.h"
+#include "defm-stream.h"
+
+using namespace Rcpp;
+
+// [[Rcpp::export(rng = false, invisible = true)]]
+SEXP save_defm_cpp(SEXP m, std::string path)
+{
+
+  if (as_mapped(m) != nullptr)
+    stop("The model was loaded with load_defm(); copy its file instead.");
+
+  Rcpp::XPtr< defm::DEFM > ptr(m);
+
+  defm_write(*ptr, path, as_native_init(m));
+
+  return m;
+
+}
+
+// [[Rcpp::export(rng = false)]]
+SEXP load_defm_cpp(std::string path)
+{
+
+  Rcpp::XPtr< DEFMMapped > ptr(new DEFMMapped(path), true);
+
+  // The pointer is wrapped in a list so functions that only work with
+  // regular DEFM objects fail with an error (instead of misreading it.)
+  List res = List::create(ptr);
+  res.attr("class") = "DEFM_mmap";
+
+  return res;
+
+}
+
+// [[Rcpp::export(rng = false)]]
+SEXP new_defm_file_cpp(
+  std::string path,
+  std::string id,
+  std::vector< std::string > y,
+  std::vector< std::string > x,
+  int order = 1,
+  std::string format = "csv",
+  std::string sep = ",",
+  int chunk_size = 100000
+) {
+
+  if (chunk_size < 1)
+    stop("-chunk_size- must be a positive integer.");
+
+  if (sep.size() != 1u)
+    stop("-sep- must be a single character.");
+
+  auto check_interrupt = []() -> void {Rcpp::checkUserInterrupt();};
+
+  // The data lives in C++ only; the model points to it (copy_data = false)
+  // and keeps it alive as the protected value of its external pointer.
+  Rcpp::XPtr< DEFMPanelData > data(new DEFMPanelData(), true);
+
+  if (format == "csv")
+  {
+
+    if (y.size() == 0u)
+      stop("-y- must name at least one column.");
+
+    defm_read_csv(
+      path, id, y, x, sep[0], static_cast< size_t >(chunk_size), *data,
+      check_interrupt
+    );
+
+  } else if (format == "binary")
+  {
+
+    defm_read_panel(
+      path, y, x, static_cast< size_t >(chunk_size), *data, check_interrupt
+    );
+
+  } else
+    stop("Unknown -format-: \"" + format + "\".");
+
+  if (data->n_rows <= static_cast< size_t >(std::max(order, 0)))
+    stop("The -order- cannot be greater than the number of observations.");
+
+  Rcpp::XPtr< defm::DEFM > model(new defm::DEFM(
+    data->ID.data(),
+    data->Y.data(),
+    data->X.data(),
+    data->n_rows,
+    data->Y_names.size(),
+    data->X_names.size(),
+    order,
+    false
+  ), true, R_NilValue, data);
+
+  model->set_names(data->Y_names, data->X_names);
+  model.attr("class") = "DEFM";
+
+  as_profile(model)->bytes_data =
+    sizeof(int) * (data->ID.capacity() + data->Y.capacity()) +
+    sizeof(double) * data->X.capacity();
+
+  return model;
+
+}
+
+// [[Rcpp::export(rng = false, invisible = true)]]
+SEXP write_defm_panel_cpp(
+  std::string path,
+  IntegerVector id,
+  IntegerMatrix Y,
+  NumericMatrix X,
+  std::vector< std::string > ynames,
+  std::vector< std::string > xnames,
+  bool append = false
+) {
+
+  const size_t n = static_cast< size_t >(id.size());
+  if ((static_cast< size_t >(Y.nrow()) != n) || (static_cast< size_t >(X.nrow()) != n))
+    stop("-id-, -Y-, and -X- must have the same number of rows.");
+
+  if ((ynames.size() != static_cast< size_t >(Y.ncol())) ||
+    (xnames.size() != static_cast< size_t >(X.ncol())))
+    stop("The column names do not match the number of columns.");
+
+  defm_write_panel(
+    path, id.begin(), Y.begin(), X.begin(), n, ynames, xnames, append
+  );
+
+  return R_NilValue;
+
+}
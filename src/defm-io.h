@@ -0,0 +1,583 @@
+#ifndef DEFM_IO_H
+#define DEFM_IO_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include "defm-likelihood.h"
+#include "defm-init.h"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Binary format of an initialized DEFM (version 1). The file starts with
+// the header below, followed by the sections it points to, each one aligned
+// to 8 bytes. Everything is stored in the byte order of the machine that
+// wrote the file (checked with `endian` when loading):
+//
+//   ID       int32   [n_rows]
+//   Y        int32   [n_rows x n_y] (column-major)
+//   X        double  [n_rows x n_x] (column-major)
+//   target   double  [n_arrays x k] (row-major, observed statistics)
+//   a2s      uint64  [n_arrays]     (support of each array)
+//   sizes    uint64  [n_support]    (rows of each support)
+//   support  double  [sum(sizes) x (1 + k)] (barry's layout)
+//   names    char    NUL-terminated: n_y Y names, n_x X names, k terms.
+#define DEFM_FILE_MAGIC   "DEFMBIN"
+#define DEFM_FILE_VERSION 1u
+#define DEFM_FILE_ENDIAN  0x01020304u
+
+struct DEFMFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t n_rows, n_y, n_x, m_order, n_obs, k;
+  uint64_t n_arrays, n_support, n_support_rows;
+  uint64_t off_ID, off_Y, off_X, off_target, off_a2s, off_sizes;
+  uint64_t off_support, off_names, size_names;
+};
+
+inline uint64_t defm_file_align(uint64_t x) {return (x + 7u) & ~uint64_t(7u);}
+
+// Writes an initialized model to `path`. If the model was initialized in
+// parallel, `store` holds the result (see defm_init_parallel().)
+inline void defm_write(
+  defm::DEFM & model,
+  const std::string & path,
+  const DEFMSupportStore * store = nullptr
+) {
+
+  const auto & target         = *model.get_stats_target();
+  const std::vector< size_t > & arrays2support = (store != nullptr) ?
+    store->arrays2support : *model.get_arrays2support();
+  const std::vector< size_t > & sizes = (store != nullptr) ?
+    store->support_nrow : *model.get_stats_support_sizes();
+  const std::vector< double > & stats_support = (store != nullptr) ?
+    store->support : *model.get_stats_support();
+
+  if (arrays2support.size() == 0u)
+    throw std::logic_error(
+      "The model has not been initialized. Use init_defm() first."
+    );
+
+  check_native_init(store, model);
+
+  // The file stores one support per group of arrays, which is what
+  // factoring avoids.
+  if ((store != nullptr) && store->factored)
+    throw std::logic_error(
+      "Models initialized with factor_covar = TRUE cannot be saved. "
+      "Use init_defm(factor_covar = FALSE)."
+    );
+
+  // Nor does the format record that the covariates were binned: loaded, the
+  // approximate supports would pass for the exact ones.
+  if ((store != nullptr) && (store->covar_bins > 0))
+    throw std::logic_error(
+      "Models initialized with covar_bins > 0 cannot be saved. "
+      "Use init_defm(covar_bins = 0)."
+    );
+
+  DEFMFileHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, DEFM_FILE_MAGIC, sizeof(DEFM_FILE_MAGIC));
+  h.version        = DEFM_FILE_VERSION;
+  h.endian         = DEFM_FILE_ENDIAN;
+  h.n_rows         = model.get_n_rows();
+  h.n_y            = model.get_n_y();
+  h.n_x            = model.get_n_covars();
+  h.m_order        = model.get_m_order();
+  h.n_obs          = model.get_n_obs();
+  h.k              = model.nterms();
+  h.n_arrays       = arrays2support.size();
+  h.n_support      = sizes.size();
+  h.n_support_rows = stats_support.size() / (h.k + 1u);
+
+  std::string names;
+  for (const auto & n : model.get_Y_names())
+    names.append(n.c_str(), n.size() + 1u);
+  for (const auto & n : model.get_X_names())
+    names.append(n.c_str(), n.size() + 1u);
+  for (const auto & n : model.colnames())
+    names.append(n.c_str(), n.size() + 1u);
+
+  uint64_t off  = defm_file_align(sizeof(DEFMFileHeader));
+  auto section  = [&off](uint64_t & where, uint64_t nbytes) -> void {
+    where = off;
+    off   = defm_file_align(off + nbytes);
+  };
+
+  section(h.off_ID, h.n_rows * sizeof(int32_t));
+  section(h.off_Y, h.n_rows * h.n_y * sizeof(int32_t));
+  section(h.off_X, h.n_rows * h.n_x * sizeof(double));
+  section(h.off_target, h.n_arrays * h.k * sizeof(double));
+  section(h.off_a2s, h.n_arrays * sizeof(uint64_t));
+  section(h.off_sizes, h.n_support * sizeof(uint64_t));
+  section(h.off_support, h.n_support_rows * (h.k + 1u) * sizeof(double));
+  section(h.off_names, names.size());
+  h.size_names = names.size();
+
+  std::FILE * f = std::fopen(path.c_str(), "wb");
+  if (f == nullptr)
+    throw std::runtime_error("Cannot open the file " + path + " for writing.");
+
+  uint64_t pos = 0u;
+  bool ok      = true;
+  auto put = [&](uint64_t where, const void * data, uint64_t nbytes) -> void {
+
+    static const char zeros[8] = {0};
+    while (ok && (pos < where))
+    {
+      ok   = std::fwrite(zeros, 1u, 1u, f) == 1u;
+      pos += 1u;
+    }
+
+    if (ok && (nbytes > 0u))
+      ok = std::fwrite(data, 1u, nbytes, f) == nbytes;
+
+    pos += nbytes;
+
+  };
+
+  put(0u, &h, sizeof(h));
+
+  // Data (the model stores Y column-major, as int)
+  const int * ID = model.get_ID();
+  const int * Y  = model.get_Y();
+  std::vector< int32_t > ibuff(ID, ID + h.n_rows);
+  put(h.off_ID, ibuff.data(), h.n_rows * sizeof(int32_t));
+
+  ibuff.assign(Y, Y + h.n_rows * h.n_y);
+  put(h.off_Y, ibuff.data(), ibuff.size() * sizeof(int32_t));
+
+  put(h.off_X, model.get_X(), h.n_rows * h.n_x * sizeof(double));
+
+  if (store != nullptr)
+    put(h.off_target, store->target.data(), store->target.size() * sizeof(double));
+  else
+    for (size_t a = 0u; a < h.n_arrays; ++a)
+      put(h.off_target + a * h.k * sizeof(double), target[a].data(), h.k * sizeof(double));
+
+  std::vector< uint64_t > ubuff(arrays2support.begin(), arrays2support.end());
+  put(h.off_a2s, ubuff.data(), ubuff.size() * sizeof(uint64_t));
+
+  ubuff.assign(sizes.begin(), sizes.end());
+  put(h.off_sizes, ubuff.data(), ubuff.size() * sizeof(uint64_t));
+
+  put(h.off_support, stats_support.data(), stats_support.size() * sizeof(double));
+  put(h.off_names, names.data(), names.size());
+
+  ok = (std::fclose(f) == 0) && ok;
+
+  if (!ok)
+    throw std::runtime_error("Error while writing the file " + path + ".");
+
+}
+
+// Read-only view of a model written by defm_write(). On POSIX systems the
+// file is memory-mapped (shared), so the pages are loaded on demand and
+// shared by all the processes mapping the same file; elsewhere, the file
+// is read into memory.
+class DEFMMapped {
+private:
+
+  const char * base = nullptr;
+  size_t nbytes     = 0u;
+  std::vector< char > buffer; ///< Used only when mmap is not available.
+
+  template< typename T >
+  const T * at(uint64_t off) const {
+    return reinterpret_cast< const T * >(base + off);
+  };
+
+  void release();
+  std::string validate();
+
+public:
+
+  DEFMFileHeader header;
+  std::string path;
+  std::vector< std::string > Y_names, X_names, term_names;
+
+  DEFMMapped(const std::string & path_);
+  ~DEFMMapped();
+
+  DEFMMapped(const DEFMMapped &) = delete;
+  DEFMMapped & operator=(const DEFMMapped &) = delete;
+
+  const int32_t * ID() const {return at< int32_t >(header.off_ID);};
+  const int32_t * Y() const {return at< int32_t >(header.off_Y);};
+  const double * X() const {return at< double >(header.off_X);};
+  const double * target() const {return at< double >(header.off_target);};
+  const uint64_t * arrays2support() const {return at< uint64_t >(header.off_a2s);};
+  const uint64_t * sizes() const {return at< uint64_t >(header.off_sizes);};
+  const double * support() const {return at< double >(header.off_support);};
+
+  DEFMLikelihood likelihood() const;
+
+};
+
+inline DEFMMapped::DEFMMapped(const std::string & path_) : path(path_)
+{
+
+  #ifdef _WIN32
+  std::ifstream f(path, std::ios::binary | std::ios::ate);
+  if (!f)
+    throw std::runtime_error("Cannot open the file " + path + ".");
+
+  nbytes = static_cast< size_t >(f.tellg());
+  buffer.resize(nbytes);
+  f.seekg(0);
+  if (!f.read(buffer.data(), nbytes))
+    throw std::runtime_error("Error while reading the file " + path + ".");
+
+  base = buffer.data();
+  #else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Cannot open the file " + path + ".");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    throw std::runtime_error("Cannot read the size of the file " + path + ".");
+  }
+
+  nbytes = static_cast< size_t >(st.st_size);
+
+  if (nbytes >= sizeof(DEFMFileHeader))
+  {
+    void * p = mmap(nullptr, nbytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED)
+      base = static_cast< const char * >(p);
+  }
+
+  close(fd); // The mapping remains valid
+
+  if ((base == nullptr) && (nbytes >= sizeof(DEFMFileHeader)))
+    throw std::runtime_error("Cannot map the file " + path + " into memory.");
+  #endif
+
+  std::string err = validate();
+  if (err != "")
+  {
+    release();
+    throw std::runtime_error(err);
+  }
+
+}
+
+// Checks the header and the sections before trusting any offset. Returns
+// an error message (empty if the file is fine.)
+inline std::string DEFMMapped::validate()
+{
+
+  if (nbytes < sizeof(DEFMFileHeader))
+    return "The file " + path + " is not a DEFM file.";
+
+  std::memcpy(&header, base, sizeof(header));
+
+  std::string err;
+  if (std::memcmp(header.magic, DEFM_FILE_MAGIC, sizeof(DEFM_FILE_MAGIC)) != 0)
+    err = "The file " + path + " is not a DEFM file.";
+  else if (header.endian != DEFM_FILE_ENDIAN)
+    err = "The file " + path + " was written on a machine with a different byte order.";
+  else if (header.version != DEFM_FILE_VERSION)
+    err = "Unsupported DEFM file version (" + std::to_string(header.version) +
+      ").";
+
+  if (err != "")
+    return err;
+
+  // The sizes come from the header, so the products saturate instead of
+  // wrapping around (a saturated size never fits in the file)
+  const uint64_t big = std::numeric_limits< uint64_t >::max();
+  auto mul = [big](uint64_t a, uint64_t b) -> uint64_t {
+    return ((a != 0u) && (b > (big / a))) ? big : a * b;
+  };
+
+  const uint64_t k1 = (header.k < big) ? header.k + 1u : big;
+  const uint64_t sections[][2] = {
+    {header.off_ID, mul(header.n_rows, sizeof(int32_t))},
+    {header.off_Y, mul(mul(header.n_rows, header.n_y), sizeof(int32_t))},
+    {header.off_X, mul(mul(header.n_rows, header.n_x), sizeof(double))},
+    {header.off_target, mul(mul(header.n_arrays, header.k), sizeof(double))},
+    {header.off_a2s, mul(header.n_arrays, sizeof(uint64_t))},
+    {header.off_sizes, mul(header.n_support, sizeof(uint64_t))},
+    {header.off_support, mul(mul(header.n_support_rows, k1), sizeof(double))},
+    {header.off_names, header.size_names}
+  };
+
+  for (const auto & sec : sections)
+    if ((sec[0u] > nbytes) || (sec[1u] > (nbytes - sec[0u])) || (sec[0u] % 8u))
+      return "The file " + path + " is truncated or corrupted.";
+
+  // The supports must be consistent with their sizes and the arrays
+  uint64_t nrows_support = 0u;
+  for (uint64_t s = 0u; s < header.n_support; ++s)
+  {
+
+    if (sizes()[s] > (header.n_support_rows - nrows_support))
+      return "The file " + path + " is corrupted.";
+
+    nrows_support += sizes()[s];
+
+  }
+
+  if (nrows_support != header.n_support_rows)
+    return "The file " + path + " is corrupted.";
+
+  for (uint64_t a = 0u; a < header.n_arrays; ++a)
+    if (arrays2support()[a] >= header.n_support)
+      return "The file " + path + " is corrupted.";
+
+  // One array per row, except for the starting rows of each id
+  uint64_t n_arrays = 0u, n_obs_i = 0u;
+  for (uint64_t i = 0u; i < header.n_rows; ++i)
+  {
+
+    if ((i > 0u) && (ID()[i - 1u] != ID()[i]))
+      n_obs_i = 0u;
+
+    if (n_obs_i++ >= header.m_order)
+      n_arrays++;
+
+  }
+
+  if (n_arrays != header.n_arrays)
+    return "The file " + path + " is corrupted.";
+
+  {
+
+    // Splitting the names
+    const char * p   = base + header.off_names;
+    const char * end = p + header.size_names;
+    auto read_names  = [&](std::vector< std::string > & res, uint64_t n) -> void {
+
+      for (uint64_t i = 0u; i < n; ++i)
+      {
+
+        const char * q = static_cast< const char * >(std::memchr(p, '\0', end - p));
+        if (q == nullptr)
+        {
+          err = "The file " + path + " is corrupted.";
+          return;
+        }
+
+        res.emplace_back(p, q);
+        p = q + 1;
+
+      }
+
+    };
+
+    read_names(Y_names, header.n_y);
+    read_names(X_names, header.n_x);
+    read_names(term_names, header.k);
+
+  }
+
+  return err;
+
+}
+
+inline void DEFMMapped::release()
+{
+
+  #ifndef _WIN32
+  if (base != nullptr)
+    munmap(const_cast< char * >(base), nbytes);
+  #endif
+
+  base = nullptr;
+  buffer.clear();
+
+}
+
+inline DEFMMapped::~DEFMMapped()
+{
+  release();
+}
+
+// The likelihood points straight into the mapped supports, so it must not
+// outlive the DEFMMapped object.
+inline DEFMLikelihood DEFMMapped::likelihood() const
+{
+
+  DEFMLikelihood res;
+  res.k = header.k;
+
+  const uint64_t * s_sizes = sizes();
+  const double * s_data    = support();
+
+  res.support.resize(header.n_support);
+  res.support_nrow.resize(header.n_support);
+  res.support_narrays.assign(header.n_support, 0.0);
+
+  uint64_t offset = 0u;
+  for (uint64_t s = 0u; s < header.n_support; ++s)
+  {
+    res.support[s]      = s_data + offset;
+    res.support_nrow[s] = s_sizes[s];
+    res.nrow_max        = std::max(res.nrow_max, res.support_nrow[s]);
+    offset             += s_sizes[s] * (header.k + 1u);
+  }
+
+  const uint64_t * a2s = arrays2support();
+  for (uint64_t a = 0u; a < header.n_arrays; ++a)
+    res.support_narrays[a2s[a]] += 1.0;
+
+  const double * t = target();
+  res.target_sum.assign(header.k, 0.0);
+  for (uint64_t a = 0u; a < header.n_arrays; ++a)
+    for (uint64_t j = 0u; j < header.k; ++j)
+      res.target_sum[j] += t[a * header.k + j];
+
+  return res;
+
+}
+
+// Returns the model loaded with load_defm() (an object of class DEFM_mmap)
+// or nullptr if `m` is something else (e.g., a regular DEFM).
+inline const DEFMMapped * as_mapped(SEXP m)
+{
+
+  if (!Rf_inherits(m, "DEFM_mmap"))
+    return nullptr;
+
+  Rcpp::List obj(m);
+  Rcpp::XPtr< DEFMMapped > ptr(static_cast< SEXP >(obj[0]));
+
+  if (ptr.get() == nullptr)
+    Rcpp::stop(
+      "The model is no longer available (objects from load_defm() cannot be "
+      "saved across sessions). Use load_defm() again."
+      );
+
+  return ptr.get();
+
+}
+
+// Builds the likelihood of either a DEFM (initialized serially or in
+// parallel) or a model loaded with load_defm(), optionally retrieving the
+// names of the terms.
+inline DEFMLikelihood get_likelihood(
+  SEXP m,
+  std::vector< std::string > * term_names = nullptr
+) {
+
+  if (const DEFMMapped * mapped = as_mapped(m))
+  {
+
+    if (term_names != nullptr)
+      *term_names = mapped->term_names;
+
+    return mapped->likelihood();
+
+  }
+
+  Rcpp::XPtr< defm::DEFM > ptr(m);
+
+  if (term_names != nullptr)
+    *term_names = ptr->colnames();
+
+  if (const DEFMSupportStore * store = as_native_init(m))
+  {
+    check_native_init(store, *ptr);
+    return store->likelihood();
+  }
+
+  return DEFMLikelihood(*ptr);
+
+}
+
+// Observed statistics of each array and the entry of the likelihood
+// returned by get_likelihood() its support corresponds to (for factored
+// models, the group of the array), along with the ids of the rows.
+class DEFMArrayView {
+public:
+  std::vector< const double * > target;
+  std::vector< size_t > entry;
+  const int * ID = nullptr;
+  size_t n_rows  = 0u;
+  size_t m_order = 0u;
+};
+
+inline DEFMArrayView get_array_view(SEXP m)
+{
+
+  DEFMArrayView res;
+
+  if (const DEFMMapped * mapped = as_mapped(m))
+  {
+
+    const size_t k        = mapped->header.k;
+    const double * t      = mapped->target();
+    const uint64_t * a2s  = mapped->arrays2support();
+    const size_t n_arrays = mapped->header.n_arrays;
+
+    res.ID      = mapped->ID();
+    res.n_rows  = mapped->header.n_rows;
+    res.m_order = mapped->header.m_order;
+
+    res.target.resize(n_arrays);
+    res.entry.resize(n_arrays);
+    for (size_t a = 0u; a < n_arrays; ++a)
+    {
+      res.target[a] = t + a * k;
+      res.entry[a]  = static_cast< size_t >(a2s[a]);
+    }
+
+    return res;
+
+  }
+
+  Rcpp::XPtr< defm::DEFM > ptr(m);
+
+  res.ID      = ptr->get_ID();
+  res.n_rows  = ptr->get_n_rows();
+  res.m_order = ptr->get_m_order();
+
+  if (const DEFMSupportStore * store = as_native_init(m))
+  {
+
+    check_native_init(store, *ptr);
+    const size_t n_arrays = store->n_arrays();
+
+    res.target.resize(n_arrays);
+    for (size_t a = 0u; a < n_arrays; ++a)
+      res.target[a] = &store->target[a * store->k];
+
+    res.entry = store->factored ? store->arrays2group : store->arrays2support;
+
+    return res;
+
+  }
+
+  const auto & target = *ptr->get_stats_target();
+
+  res.target.resize(target.size());
+  for (size_t a = 0u; a < target.size(); ++a)
+    res.target[a] = target[a].data();
+
+  res.entry.assign(
+    ptr->get_arrays2support()->begin(), ptr->get_arrays2support()->end()
+  );
+
+  return res;
+
+}
+
+#endif
@@ -0,0 +1,672 @@
+#ifndef DEFM_LIKELIHOOD_H
+#define DEFM_LIKELIHOOD_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include "defm-simd.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Computes the log normalizing constant of a single support set and,
+// optionally, the expected value (mean, of length k) and covariance (cov,
+// k x k, column-major) of the sufficient statistics under it.
+//
+// The support is stored as in barry: row-wise, with `1 + k` entries per row,
+// the first being the weight (number of arrays in the support sharing the
+// statistics.) `expo` is scratch space of length `nrow`. The computation
+// is shifted by the largest exponent so it is safe for large parameters.
+inline double support_moments(
+  const double * par,
+  const double * support,
+  size_t nrow,
+  size_t k,
+  double * expo,
+  double * mean = nullptr,
+  double * cov  = nullptr
+) {
+
+  const size_t stride = k + 1u;
+
+  double amax = -std::numeric_limits< double >::infinity();
+  for (size_t r = 0u; r < nrow; ++r)
+  {
+
+    const double * s = support + r * stride + 1u;
+
+    double a = 0.0;
+    for (size_t j = 0u; j < k; ++j)
+      a += par[j] * s[j];
+
+    expo[r] = a;
+    if (a > amax)
+      amax = a;
+
+  }
+
+  double z = 0.0;
+  for (size_t r = 0u; r < nrow; ++r)
+  {
+    expo[r] = support[r * stride] * std::exp(expo[r] - amax);
+    z += expo[r];
+  }
+
+  if (mean == nullptr)
+    return amax + std::log(z);
+
+  std::fill(mean, mean + k, 0.0);
+  for (size_t r = 0u; r < nrow; ++r)
+  {
+
+    const double * s = support + r * stride + 1u;
+    const double w   = expo[r] / z;
+
+    for (size_t j = 0u; j < k; ++j)
+      mean[j] += w * s[j];
+
+  }
+
+  if (cov == nullptr)
+    return amax + std::log(z);
+
+  // Centered second moments (more stable than E[t t'] - E[t]E[t]')
+  std::fill(cov, cov + k * k, 0.0);
+  for (size_t r = 0u; r < nrow; ++r)
+  {
+
+    const double * s = support + r * stride + 1u;
+    const double w   = expo[r] / z;
+
+    for (size_t j = 0u; j < k; ++j)
+    {
+
+      const double dj = w * (s[j] - mean[j]);
+      for (size_t l = j; l < k; ++l)
+        cov[j * k + l] += dj * (s[l] - mean[l]);
+
+    }
+
+  }
+
+  for (size_t j = 0u; j < k; ++j)
+    for (size_t l = j + 1u; l < k; ++l)
+      cov[l * k + j] = cov[j * k + l];
+
+  return amax + std::log(z);
+
+}
+
+// Same as support_moments() for a support stored column-wise (see
+// DEFMLikelihood::pack()): `block` holds the weights followed by the k
+// statistics, each a column of `npad` entries (the rows past `nrow` are
+// zero.) `expo` has length `npad` and `center`, only used for the
+// covariance, k * npad.
+//
+// The exponents, means, and covariances go through the vectorized kernels;
+// the exponential itself is computed one row at a time.
+inline double support_moments_soa(
+  const double * par,
+  const double * block,
+  size_t nrow,
+  size_t npad,
+  size_t k,
+  double * expo,
+  double * center = nullptr,
+  double * mean   = nullptr,
+  double * cov    = nullptr
+) {
+
+  const DEFMKernels & kern = defm_kernels();
+  const double * weight    = block;
+  const double * stats     = block + npad;
+
+  // a_r = theta' s_r, accumulated one term (column) at a time
+  std::fill(expo, expo + npad, 0.0);
+  for (size_t j = 0u; j < k; ++j)
+    if (par[j] != 0.0)
+      kern.axpy(expo, stats + j * npad, par[j], npad);
+
+  double amax = -std::numeric_limits< double >::infinity();
+  for (size_t r = 0u; r < nrow; ++r)
+    if (expo[r] > amax)
+      amax = expo[r];
+
+  double z = 0.0;
+  for (size_t r = 0u; r < nrow; ++r)
+  {
+    expo[r] = weight[r] * std::exp(expo[r] - amax);
+    z += expo[r];
+  }
+
+  // The padding must not contribute to the sums below
+  std::fill(expo + nrow, expo + npad, 0.0);
+
+  if (mean == nullptr)
+    return amax + std::log(z);
+
+  for (size_t j = 0u; j < k; ++j)
+    mean[j] = kern.dot(expo, stats + j * npad, npad) / z;
+
+  if (cov == nullptr)
+    return amax + std::log(z);
+
+  for (size_t j = 0u; j < k; ++j)
+  {
+    const double * s = stats + j * npad;
+    double * c       = center + j * npad;
+    for (size_t r = 0u; r < npad; ++r)
+      c[r] = s[r] - mean[j];
+  }
+
+  for (size_t j = 0u; j < k; ++j)
+    for (size_t l = j; l < k; ++l)
+    {
+      cov[j * k + l] = kern.dot3(
+        expo, center + j * npad, center + l * npad, npad
+      ) / z;
+      cov[l * k + j] = cov[j * k + l];
+    }
+
+  return amax + std::log(z);
+
+}
+
+// Flat view of the pieces of an initialized DEFM needed to evaluate the
+// log-likelihood and its derivatives. Since the DEFM is an exponential
+// family, these only depend on the sum of the observed statistics and,
+// for each unique support, the support itself and the number of arrays
+// using it:
+//
+//   loglik   = theta' sum_i t_i - sum_s n_s log Z_s(theta)
+//   gradient = sum_i t_i - sum_s n_s E_s[t]
+//   hessian  = - sum_s n_s Cov_s[t]
+//
+// The view does not own the support; it points to the memory held by the
+// model, so it must not outlive it (or survive a call to init_defm().)
+class DEFMLikelihood {
+public:
+
+  size_t k = 0u;                          ///< Number of terms.
+  std::vector< const double * > support;  ///< Start of each support.
+  std::vector< size_t > support_nrow;     ///< Rows in each support.
+  std::vector< double > support_narrays;  ///< Arrays using each support.
+  std::vector< double > target_sum;       ///< Sum of the observed stats.
+  size_t nrow_max = 0u;                   ///< Largest support.
+
+  // Optional multipliers of the statistics of each support (n_support x k):
+  // the statistics of support `s` are those stored times scale[s * k + j]
+  // (see defm_init_factored().) Empty means all ones.
+  std::vector< double > scale;
+
+  // Column-wise copy of the supports built by pack(). Empty means eval()
+  // reads the supports in barry's row-wise layout.
+  DEFMAlignedDoubles soa;
+  std::vector< size_t > soa_offset;       ///< Start of each support in soa.
+
+  DEFMLikelihood() {};
+  DEFMLikelihood(defm::DEFM & model);
+
+  // Returns the log-likelihood. When `grad` (length k) and/or `hess`
+  // (k x k, column-major) are not null, they are filled with the gradient
+  // and the Hessian of the log-likelihood.
+  double eval(
+    const double * par,
+    double * grad = nullptr,
+    double * hess = nullptr,
+    int ncores = 1
+  ) const;
+
+  // Log normalizing constant of each support at `par` (logz has length
+  // size()), e.g., to compute the contribution of each array.
+  void log_normalizers(
+    const double * par,
+    double * logz,
+    int ncores = 1
+  ) const;
+
+  // Log-likelihood of `npar` parameter vectors at once. `par` is k x npar,
+  // stored term by term (par[j * npar + p] is term j of vector p), and
+  // `res` has length npar. The supports are traversed once for the whole
+  // batch: each row's statistics are broadcast across the vectors, and
+  // the exponentials computed with the vectorized kernels.
+  void eval_batch(
+    const double * par,
+    size_t npar,
+    double * res,
+    int ncores = 1
+  ) const;
+
+  // Copies the supports into a column-wise layout padded to the SIMD width
+  // so eval() can use the vectorized kernels (see defm-simd.h.) Worth it
+  // when the likelihood is evaluated many times, e.g., while fitting. Must
+  // be called again if the supports change.
+  void pack();
+  void unpack();
+  bool packed() const noexcept {
+    return (soa_offset.size() > 0u) && (soa_offset.size() == support.size());
+  };
+
+  size_t size() const noexcept {return support.size();};
+
+};
+
+inline DEFMLikelihood::DEFMLikelihood(defm::DEFM & model)
+{
+
+  const auto & stats_support = *model.get_stats_support();
+  const auto & sizes         = *model.get_stats_support_sizes();
+  const auto & arrays2support = *model.get_arrays2support();
+  const auto & target        = *model.get_stats_target();
+
+  if (arrays2support.size() == 0u)
+    throw std::logic_error(
+      "The model has not been initialized. Use init_defm() first."
+    );
+
+  k = model.nterms();
+
+  // Locating each support within barry's flat storage
+  size_t n_support = sizes.size();
+  support.resize(n_support);
+  support_nrow.assign(sizes.begin(), sizes.end());
+  support_narrays.assign(n_support, 0.0);
+
+  size_t offset = 0u;
+  for (size_t s = 0u; s < n_support; ++s)
+  {
+    support[s] = stats_support.data() + offset;
+    offset    += sizes[s] * (k + 1u);
+    nrow_max   = std::max(nrow_max, sizes[s]);
+  }
+
+  for (const auto & s : arrays2support)
+    support_narrays[s] += 1.0;
+
+  // The observed statistics enter the likelihood only through their sum
+  target_sum.assign(k, 0.0);
+  for (const auto & t : target)
+    for (size_t j = 0u; j < k; ++j)
+      target_sum[j] += t[j];
+
+}
+
+inline void DEFMLikelihood::log_normalizers(
+  const double * par,
+  double * logz,
+  int ncores
+) const {
+
+  const size_t n_support = support.size();
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    const bool use_soa = packed();
+    std::vector< double > expo(
+      use_soa ? defm_simd_pad(nrow_max) : nrow_max
+    );
+    std::vector< double > par_s(scale.size() > 0u ? k : 0u);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t s = 0u; s < n_support; ++s)
+    {
+
+      const double * par_use = par;
+      if (scale.size() > 0u)
+      {
+        for (size_t j = 0u; j < k; ++j)
+          par_s[j] = par[j] * scale[s * k + j];
+        par_use = par_s.data();
+      }
+
+      logz[s] = use_soa ?
+        support_moments_soa(
+          par_use, soa.data() + soa_offset[s], support_nrow[s],
+          defm_simd_pad(support_nrow[s]), k, expo.data()
+        ) :
+        support_moments(
+          par_use, support[s], support_nrow[s], k, expo.data()
+        );
+
+    }
+
+  }
+
+}
+
+inline void DEFMLikelihood::eval_batch(
+  const double * par,
+  size_t npar,
+  double * res,
+  int ncores
+) const {
+
+  const size_t n_support = support.size();
+  const size_t stride    = k + 1u;
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  // The vectors are evaluated in lanes of up to `nlane` (each a SIMD lane
+  // of the kernels), and the rows of a support in tiles of `ntile`, so the
+  // exponents of a tile stay in cache.
+  const size_t nlane   = std::min(defm_simd_pad(npar), size_t(256u));
+  const size_t ntile   = 32u;
+  const size_t nchunks = (npar + nlane - 1u) / nlane;
+
+  // Padded copy of the parameters so the kernels need no remainder loops
+  const size_t npad = nchunks * nlane;
+  std::vector< double > par_pad(k * npad, 0.0);
+  for (size_t j = 0u; j < k; ++j)
+    std::copy(par + j * npar, par + (j + 1u) * npar, &par_pad[j * npad]);
+
+  // The supports are split in fixed blocks, each with its own partial sums
+  // (added in order below), so the result does not depend on `ncores`.
+  const size_t block   = 64u;
+  const size_t nblocks = (n_support + block - 1u) / block;
+  std::vector< double > partial(nblocks * npad, 0.0);
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    const DEFMKernels & kern = defm_kernels();
+
+    // Exponents of the rows of the tile, their exponentials, running maxima,
+    // and running sums
+    std::vector< double > expo(ntile * nlane), ex(nlane);
+    std::vector< double > amax(nlane), tmax(nlane), z(nlane);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(dynamic) collapse(2)
+    #endif
+    for (size_t b = 0u; b < nblocks; ++b)
+      for (size_t c = 0u; c < nchunks; ++c)
+      {
+
+        double * out      = &partial[b * npad + c * nlane];
+        const size_t last = std::min(n_support, (b + 1u) * block);
+
+        for (size_t s = b * block; s < last; ++s)
+        {
+
+          const double * sc = scale.size() > 0u ? &scale[s * k] : nullptr;
+          const size_t nrow = support_nrow[s];
+
+          std::fill(
+            amax.begin(), amax.end(), -std::numeric_limits< double >::infinity()
+          );
+          std::fill(z.begin(), z.end(), 0.0);
+
+          for (size_t r0 = 0u; r0 < nrow; r0 += ntile)
+          {
+
+            const size_t nr = std::min(ntile, nrow - r0);
+
+            // a_rp = sum_j s_rj theta_jp, one term at a time across the lane
+            std::fill(expo.begin(), expo.begin() + nr * nlane, 0.0);
+            for (size_t r = 0u; r < nr; ++r)
+            {
+
+              const double * row = support[s] + (r0 + r) * stride;
+              for (size_t j = 0u; j < k; ++j)
+              {
+
+                const double sj = row[1u + j] * (sc != nullptr ? sc[j] : 1.0);
+                if (sj != 0.0)
+                  kern.axpy(
+                    &expo[r * nlane], &par_pad[j * npad + c * nlane], sj, nlane
+                  );
+
+              }
+
+            }
+
+            // Moving the maxima (and rescaling the sums) once per tile
+            std::copy(amax.begin(), amax.end(), tmax.begin());
+            for (size_t r = 0u; r < nr; ++r)
+              for (size_t p = 0u; p < nlane; ++p)
+                tmax[p] = std::max(tmax[p], expo[r * nlane + p]);
+
+            if (r0 > 0u)
+            {
+              kern.exp(ex.data(), amax.data(), tmax.data(), nlane);
+              for (size_t p = 0u; p < nlane; ++p)
+                z[p] *= ex[p];
+            }
+
+            std::copy(tmax.begin(), tmax.end(), amax.begin());
+
+            for (size_t r = 0u; r < nr; ++r)
+            {
+
+              const double w = support[s][(r0 + r) * stride];
+              kern.exp(ex.data(), &expo[r * nlane], amax.data(), nlane);
+              kern.axpy(z.data(), ex.data(), w, nlane);
+
+            }
+
+          }
+
+          for (size_t p = 0u; p < nlane; ++p)
+            out[p] -= support_narrays[s] * (amax[p] + std::log(z[p]));
+
+        }
+
+      }
+
+  }
+
+  for (size_t p = 0u; p < npar; ++p)
+  {
+
+    double ans = 0.0;
+    for (size_t j = 0u; j < k; ++j)
+      ans += par[j * npar + p] * target_sum[j];
+
+    for (size_t b = 0u; b < nblocks; ++b)
+      ans += partial[b * npad + p];
+
+    res[p] = ans;
+
+  }
+
+}
+
+inline void DEFMLikelihood::pack()
+{
+
+  const size_t n_support = support.size();
+  const size_t stride    = k + 1u;
+
+  soa_offset.resize(n_support);
+
+  size_t total = 0u;
+  for (size_t s = 0u; s < n_support; ++s)
+  {
+    soa_offset[s] = total;
+    total += defm_simd_pad(support_nrow[s]) * stride;
+  }
+
+  soa.assign(total, 0.0);
+  double * dat = soa.data();
+
+  for (size_t s = 0u; s < n_support; ++s)
+  {
+
+    const size_t npad = defm_simd_pad(support_nrow[s]);
+    double * block    = dat + soa_offset[s];
+
+    for (size_t r = 0u; r < support_nrow[s]; ++r)
+    {
+      const double * row = support[s] + r * stride;
+      for (size_t j = 0u; j < stride; ++j)
+        block[j * npad + r] = row[j];
+    }
+
+  }
+
+}
+
+inline void DEFMLikelihood::unpack()
+{
+  soa = DEFMAlignedDoubles();
+  soa_offset.clear();
+}
+
+inline double DEFMLikelihood::eval(
+  const double * par,
+  double * grad,
+  double * hess,
+  int ncores
+) const {
+
+  const size_t n_support = support.size();
+
+  // Each thread accumulates into its own buffer, which are added in thread
+  // order at the end. With a static schedule this makes the result the
+  // same across runs for a given number of threads.
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  if (static_cast< size_t >(ncores) > n_support)
+    ncores = std::max(static_cast< int >(n_support), 1);
+
+  const size_t buff_size = 1u +
+    (grad != nullptr ? k : 0u) +
+    (hess != nullptr ? k * k : 0u);
+
+  std::vector< double > buffers(buff_size * ncores, 0.0);
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    #ifdef _OPENMP
+    int tid = omp_get_thread_num();
+    #else
+    int tid = 0;
+    #endif
+
+    const bool use_soa = packed();
+    const size_t npad_max = defm_simd_pad(nrow_max);
+
+    std::vector< double > expo(use_soa ? npad_max : nrow_max);
+    std::vector< double > center(
+      (use_soa && (hess != nullptr)) ? k * npad_max : 0u
+    );
+    std::vector< double > mean(
+      (grad != nullptr || hess != nullptr) ? k : 0u
+    );
+    std::vector< double > cov(hess != nullptr ? k * k : 0u);
+
+    // With multipliers, theta' s = (theta * scale)' s_base
+    std::vector< double > par_s(scale.size() > 0u ? k : 0u);
+
+    double * buff      = &buffers[tid * buff_size];
+    double * buff_grad = buff + 1u;
+    double * buff_hess = buff_grad + (grad != nullptr ? k : 0u);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t s = 0u; s < n_support; ++s)
+    {
+
+      const double n_s = support_narrays[s];
+      const double * sc = scale.size() > 0u ? &scale[s * k] : nullptr;
+
+      if (sc != nullptr)
+        for (size_t j = 0u; j < k; ++j)
+          par_s[j] = par[j] * sc[j];
+
+      const double * par_use = sc != nullptr ? par_s.data() : par;
+      double * mean_use = (grad != nullptr || hess != nullptr) ?
+        mean.data() : nullptr;
+      double * cov_use  = hess != nullptr ? cov.data() : nullptr;
+
+      double logz = use_soa ?
+        support_moments_soa(
+          par_use, soa.data() + soa_offset[s], support_nrow[s],
+          defm_simd_pad(support_nrow[s]), k, expo.data(), center.data(),
+          mean_use, cov_use
+        ) :
+        support_moments(
+          par_use, support[s], support_nrow[s], k, expo.data(),
+          mean_use, cov_use
+        );
+
+      buff[0u] -= n_s * logz;
+
+      if (grad != nullptr)
+        for (size_t j = 0u; j < k; ++j)
+          buff_grad[j] -= n_s * mean[j] * (sc != nullptr ? sc[j] : 1.0);
+
+      if (hess != nullptr)
+        for (size_t i = 0u; i < k; ++i)
+          for (size_t j = 0u; j < k; ++j)
+            buff_hess[i * k + j] -= n_s * cov[i * k + j] * (
+              sc != nullptr ? sc[i] * sc[j] : 1.0
+            );
+
+    }
+
+  }
+
+  // Observed part
+  double res = 0.0;
+  for (size_t j = 0u; j < k; ++j)
+    res += par[j] * target_sum[j];
+
+  if (grad != nullptr)
+    std::copy(target_sum.begin(), target_sum.end(), grad);
+
+  if (hess != nullptr)
+    std::fill(hess, hess + k * k, 0.0);
+
+  for (int t = 0; t < ncores; ++t)
+  {
+
+    const double * buff = &buffers[t * buff_size];
+    res += buff[0u];
+
+    if (grad != nullptr)
+      for (size_t j = 0u; j < k; ++j)
+        grad[j] += buff[1u + j];
+
+    if (hess != nullptr)
+    {
+      const double * buff_hess = buff + 1u + (grad != nullptr ? k : 0u);
+      for (size_t j = 0u; j < (k * k); ++j)
+        hess[j] += buff_hess[j];
+    }
+
+  }
+
+  return res;
+
+}
+
+#endif
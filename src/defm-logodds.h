@@ -0,0 +1,134 @@
+#ifndef DEFM_LOGODDS_H
+#define DEFM_LOGODDS_H
+
+#include <vector>
+#include <limits>
+#include "defm-init.h"
+
+// Log-odds of the cells `cells` of every observation's array (see
+// logodds_all().) Cell (t, y) is listed as y + t * n_y. The log-odds of a
+// cell is par' (s(1) - s(0)), where s(v) are the statistics of the observed
+// array with that cell set to v. The observed array gives one of the two, so
+// each cell costs a single count after toggling it.
+//
+// `res` is n_rows x cells.size(), column-major (as an R matrix); rows within
+// the Markov order of each id are set to NaN.
+inline void defm_logodds_cells(
+  defm::DEFM & model,
+  const std::vector< double > & par,
+  const std::vector< size_t > & cells,
+  double * res,
+  int ncores
+) {
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const size_t k       = model.nterms();
+  const int * Y        = model.get_Y();
+
+  if (par.size() != k)
+    throw std::length_error(
+      "The length of -par- (" + std::to_string(par.size()) +
+      ") does not match the number of terms (" + std::to_string(k) + ")."
+    );
+
+  std::vector< int > rows;
+  rows2arrays(model, 0u, nrows, rows);
+
+  DEFMThreadError err;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    defm::DEFMArray array;
+    defm::DEFMStatsCounter counter;
+    for (size_t j = 0u; j < k; ++j)
+      counter.add_counter((*model.get_counters())[j]);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t i = 0u; i < nrows; ++i)
+    {
+
+      if (rows[i] < 0)
+      {
+
+        for (size_t c = 0u; c < cells.size(); ++c)
+          res[i + c * nrows] = std::numeric_limits< double >::quiet_NaN();
+
+        continue;
+
+      }
+
+      try {
+
+        const size_t start = i - m_order;
+
+        fill_array_window(model, array, start);
+        for (size_t y = 0u; y < n_y; ++y)
+          array(m_order, y) = Y[y * nrows + i];
+
+        counter.reset_array(&array);
+        const std::vector< double > observed = counter.count_all();
+
+        for (size_t c = 0u; c < cells.size(); ++c)
+        {
+
+          const size_t t  = cells[c] / n_y;
+          const size_t y  = cells[c] % n_y;
+          const int value = array(t, y);
+
+          array(t, y) = 1 - value;
+          counter.reset_array(&array);
+          const std::vector< double > toggled = counter.count_all();
+          array(t, y) = value;
+
+          // s(1) - s(0), whichever one the observed array is
+          double lo = 0.0;
+          for (size_t j = 0u; j < k; ++j)
+            lo += par[j] * (toggled[j] - observed[j]);
+
+          res[i + c * nrows] = (value == 0) ? lo : -lo;
+
+        }
+
+      } catch (const std::exception & e) {
+        err.set(e);
+      }
+
+    }
+
+  }
+
+  err.rethrow();
+
+}
+
+// Log-odds of every cell: `res` is n_rows x n_y x (m_order + 1) (see
+// defm_logodds_cells().)
+inline void defm_logodds_all(
+  defm::DEFM & model,
+  const std::vector< double > & par,
+  double * res,
+  int ncores
+) {
+
+  std::vector< size_t > cells(model.get_n_y() * (model.get_m_order() + 1u));
+  for (size_t c = 0u; c < cells.size(); ++c)
+    cells[c] = c;
+
+  defm_logodds_cells(model, par, cells, res, ncores);
+
+}
+
+#endif
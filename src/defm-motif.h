@@ -0,0 +1,317 @@
+#ifndef DEFM_MOTIF_H
+#define DEFM_MOTIF_H
+
+#include <vector>
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include <tuple>
+#include "defm-arrays.h"
+#include "defm-bits.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Motif census (see motif_census().) A motif is the (m_order + 1) x |set|
+// window of the outcomes in `set` ending at an observation. Its cells are
+// read time-major (all the outcomes at t = 0, then t = 1, ...), which is
+// also the order of the columns of the census, and packed as the bits of a
+// 64-bit key, so sets can have up to 64 cells.
+#define DEFM_MOTIF_MAX_CELLS 64u
+
+// Sets with up to this many cells are counted in a flat table indexed by the
+// key (2^16 entries at most) instead of a hash map.
+#define DEFM_MOTIF_DENSE_CELLS 16u
+
+class DEFMMotifCensus {
+public:
+
+  size_t ncells = 0u;
+  std::vector< uint64_t > keys;   ///< Motifs, in order of first appearance.
+  std::vector< int > counts;      ///< Number of times each motif appears.
+
+  // Value of cell `c` of motif `i`
+  int cell(size_t i, size_t c) const {
+    return static_cast< int >((keys[i] >> c) & 1u);
+  };
+
+};
+
+// Shard of a key (the bits are mixed first, as motifs tend to differ only
+// in a few of them)
+inline size_t defm_motif_shard(uint64_t key, size_t nshards)
+{
+  key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+  return static_cast< size_t >((key ^ (key >> 31)) % nshards);
+}
+
+inline size_t defm_motif_ncells(
+  const std::vector< size_t > & set,
+  size_t n_y,
+  size_t m_order
+) {
+
+  if (set.size() == 0u)
+    throw std::range_error("The -idx- for motif accounting is empty.");
+
+  for (const auto & y : set)
+    if (y >= n_y)
+      throw std::range_error(
+        "The -idx- for motif accounting is out of range (" +
+        std::to_string(y) + " >= " + std::to_string(n_y) + ")."
+      );
+
+  return set.size() * (m_order + 1u);
+
+}
+
+// Censuses all the `sets` in a single pass over the data. Each thread
+// counts its share of the rows in its own tables, which are then split in
+// shards by key and merged in parallel, one shard per thread (small sets use
+// flat tables, merged one set per thread.) Motifs are
+// sorted by the first row featuring them, so the result is the same as a
+// serial census regardless of the number of threads.
+//
+// `Y` is n_rows x n_y (column-major) and `ID` marks the rows of each
+// process, as in the model.
+inline std::vector< DEFMMotifCensus > defm_motif_census(
+  const int * Y,
+  const int * ID,
+  size_t n_rows,
+  size_t n_y,
+  size_t m_order,
+  const std::vector< std::vector< size_t > > & sets,
+  int ncores
+) {
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  const size_t nsets = sets.size();
+  std::vector< DEFMMotifCensus > res(nsets);
+
+  for (size_t s = 0u; s < nsets; ++s)
+  {
+
+    res[s].ncells = defm_motif_ncells(sets[s], n_y, m_order);
+    if (res[s].ncells > DEFM_MOTIF_MAX_CELLS)
+      throw std::length_error(
+        "Motifs can have at most " + std::to_string(DEFM_MOTIF_MAX_CELLS) +
+        " cells (the set " + std::to_string(s + 1u) + " has " +
+        std::to_string(res[s].ncells) + ")."
+      );
+
+  }
+
+  std::vector< int > rows;
+  rows2arrays(ID, m_order, 0u, n_rows, rows);
+
+  // The outcomes of each row as bits, so building a key reads one or two
+  // cache lines instead of one per outcome
+  DEFMBitRows ybits(n_y, n_rows);
+
+  // Count and first row (the merge keeps the smallest)
+  struct Entry {
+    int count    = 0;
+    size_t first = 0u;
+  };
+
+  typedef std::unordered_map< uint64_t, Entry > Table;
+
+  std::vector< bool > dense(nsets);
+  for (size_t s = 0u; s < nsets; ++s)
+    dense[s] = res[s].ncells <= DEFM_MOTIF_DENSE_CELLS;
+
+  // tables[(tid * nsets + s) * nshards + shard] and flat[tid * nsets + s]
+  const size_t nshards = static_cast< size_t >(ncores);
+  std::vector< Table > tables(nshards * nsets * nshards);
+  std::vector< std::vector< Entry > > flat(nshards * nsets);
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    #ifdef _OPENMP
+    const size_t tid = static_cast< size_t >(omp_get_thread_num());
+    #else
+    const size_t tid = 0u;
+    #endif
+
+    std::vector< Table > local(nsets);
+    for (size_t s = 0u; s < nsets; ++s)
+      if (dense[s])
+        flat[tid * nsets + s].resize(size_t(1u) << res[s].ncells);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t i = 0u; i < n_rows; ++i)
+      ybits.set_row(i, Y + i, n_rows);
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t i = 0u; i < n_rows; ++i)
+    {
+
+      if (rows[i] < 0)
+        continue;
+
+      const size_t start = i - m_order;
+
+      for (size_t s = 0u; s < nsets; ++s)
+      {
+
+        uint64_t key = 0u;
+        size_t bit   = 0u;
+        for (size_t t = 0u; t <= m_order; ++t)
+        {
+          const uint64_t * w = ybits.row(start + t);
+          for (const auto & y : sets[s])
+            key |= static_cast< uint64_t >(DEFMBitRows::get(w, y)) << bit++;
+        }
+
+        Entry & e = dense[s] ?
+          flat[tid * nsets + s][key] : local[s][key];
+
+        if (e.count++ == 0)
+          e.first = i;
+
+      }
+
+    }
+
+    // Splitting the local tables into shards
+    for (size_t s = 0u; s < nsets; ++s)
+    {
+
+      for (const auto & kv : local[s])
+      {
+        tables[
+          (tid * nsets + s) * nshards + defm_motif_shard(kv.first, nshards)
+        ].emplace(kv.first, kv.second);
+      }
+
+      Table().swap(local[s]);
+
+    }
+
+    #ifdef _OPENMP
+    #pragma omp barrier
+    #endif
+
+    // Merging: shard `sh` of every thread goes into that of thread 0 (flat
+    // tables are merged whole by the job of shard 0)
+    #ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for (size_t job = 0u; job < (nsets * nshards); ++job)
+    {
+
+      const size_t s  = job / nshards;
+      const size_t sh = job % nshards;
+
+      if (dense[s])
+      {
+
+        if (sh != 0u)
+          continue;
+
+        std::vector< Entry > & dest = flat[s];
+        for (size_t t = 1u; t < nshards; ++t)
+        {
+
+          std::vector< Entry > & src = flat[t * nsets + s];
+          for (size_t key = 0u; key < src.size(); ++key)
+          {
+
+            if (src[key].count == 0)
+              continue;
+
+            if ((dest[key].count == 0) || (src[key].first < dest[key].first))
+              dest[key].first = src[key].first;
+
+            dest[key].count += src[key].count;
+
+          }
+
+          std::vector< Entry >().swap(src);
+
+        }
+
+        continue;
+
+      }
+
+      Table & dest = tables[s * nshards + sh];
+      for (size_t t = 1u; t < nshards; ++t)
+      {
+
+        Table & src = tables[(t * nsets + s) * nshards + sh];
+        for (const auto & kv : src)
+        {
+
+          auto ins = dest.emplace(kv.first, kv.second);
+          if (!ins.second)
+          {
+            ins.first->second.count += kv.second.count;
+            ins.first->second.first = std::min(
+              ins.first->second.first, kv.second.first
+            );
+          }
+
+        }
+
+        Table().swap(src);
+
+      }
+
+    }
+
+  }
+
+  // Collecting the motifs in order of first appearance
+  for (size_t s = 0u; s < nsets; ++s)
+  {
+
+    // (first row, count, key)
+    std::vector< std::tuple< size_t, int, uint64_t > > order;
+    if (dense[s])
+    {
+      const std::vector< Entry > & tab = flat[s];
+      for (size_t key = 0u; key < tab.size(); ++key)
+        if (tab[key].count > 0)
+          order.emplace_back(tab[key].first, tab[key].count, key);
+    }
+    else
+    {
+      for (size_t sh = 0u; sh < nshards; ++sh)
+        for (const auto & kv : tables[s * nshards + sh])
+          order.emplace_back(kv.second.first, kv.second.count, kv.first);
+    }
+
+    std::sort(order.begin(), order.end());
+
+    res[s].keys.reserve(order.size());
+    res[s].counts.reserve(order.size());
+    for (const auto & o : order)
+    {
+      res[s].counts.push_back(std::get< 1 >(o));
+      res[s].keys.push_back(std::get< 2 >(o));
+    }
+
+  }
+
+  return res;
+
+}
+
+#endif
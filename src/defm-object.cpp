@@ -2,10 +2,19 @@
 
 // Lets barry check for user interrupts (Ctrl-C) during long-running
 // computations such as the support enumeration in init_defm().
-#define BARRY_USER_INTERRUPT Rcpp::checkUserInterrupt();
+#include "defm-interrupt.h"
 
 #include <barry/barry.hpp>
 #include <barry/models/defm.hpp>
+#include "defm-common.h"
+#include "defm-likelihood.h"
+#include "defm-simulate.h"
+#include "defm-init.h"
+#include "defm-io.h"
+#include "defm-diagnostics.h"
+#include "defm-quantize.h"
+#include "defm-logodds.h"
+#include "defm-motif.h"
 
 using namespace Rcpp;
 
@@ -111,6 +120,13 @@ SEXP new_defm(
 
   model.attr("class") = "DEFM";
 
+  // barry keeps its own copy of the data (ids, outcomes, and covariates)
+  if (copy_data)
+    as_profile(model)->bytes_data = static_cast< uint64_t >(n_id) * (
+      sizeof(int) * static_cast< uint64_t >(1 + n_y) +
+      sizeof(double) * static_cast< uint64_t >(n_x)
+    );
+
   return model;
 
 }
@@ -162,6 +178,10 @@ SEXP set_names(
 CharacterVector get_Y_names(
     SEXP m
 ) {
+
+  if (const DEFMMapped * mapped = as_mapped(m))
+    return wrap(mapped->Y_names);
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
   return wrap(ptr->get_Y_names());
 }
@@ -172,6 +192,10 @@ CharacterVector get_Y_names(
 CharacterVector get_X_names(
     SEXP m
 ) {
+
+  if (const DEFMMapped * mapped = as_mapped(m))
+    return wrap(mapped->X_names);
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
   return wrap(ptr->get_X_names());
 }
@@ -188,22 +212,213 @@ CharacterVector get_X_names(
 //' consider each array added as completely unique, even if it has the
 //' same support set as an existing array. This is an experimental feature
 //' and should be used with caution.  
+//' @param ncores Integer scalar. When greater than one (and OpenMP is
+//' available), the model is initialized in parallel (see details).
+//' @details
+//' Each array is hashed, the keys are deduplicated, and each unique support
+//' set is enumerated exactly once. With `ncores > 1`, the arrays are split
+//' across threads, deduplicated through a concurrent map, and the support
+//' sets are enumerated by any thread. Support sets are numbered in order of
+//' first appearance, so neither the result nor the functions available
+//' depend on the number of threads: [logodds()] is computed from the data
+//' (as [logodds_all()]), and `print` and `print_stats` describe the support
+//' sets of the model.
+//'
+//' Terms added with `td_ones()`, `td_generic()`, `td_formula()`, and
+//' `td_logit_intercept()` are compiled into bit masks, and each support set
+//' is enumerated by walking its possible last rows in Gray-code order, so
+//' each step updates only the terms involving the cell that changed. Rules
+//' added with `rule_not_one_to_zero()` and `rule_constrain_support()` prune
+//' the enumeration. Other terms or rules are enumerated with barry's
+//' support function instead ([defm_profile()] reports which was used).
+//'
+//' Terms added after the initialization are appended to the existing support
+//' sets, computing only the new statistics, so there is no need to call
+//' `init_defm` again. Rules, on the other hand, change the support sets:
+//' adding one discards the initialization.
+//' @param factor_covar Logical scalar. When `TRUE`, covariates are factored
+//' out of the support sets (see details).
+//' @details
+//' Terms weighted by a covariate (e.g., `td_logit_intercept(m, covar = "x")`
+//' or `"{y0} x x"`) make arrays with different covariate values have
+//' different support sets, even though their statistics only differ by the
+//' value of the covariate. With `factor_covar = TRUE`, each support set is
+//' enumerated once with all the covariates set to one, and each array keeps
+//' the multipliers of its statistics, which are applied to the parameters
+//' when evaluating the likelihood. Arrays with the same support set and
+//' multipliers are evaluated together. Continuous covariates no longer
+//' multiply the number of support sets.
+//'
+//' The factoring is checked on the observed data of every array and on the
+//' full support set of a sample of arrays; terms that are not a statistic
+//' times a covariate, or rules that depend on the covariates, raise an
+//' error. Models initialized this way are used as any other, except that
+//' [save_defm()] is not available and adding terms initializes the model
+//' again.
+//' @param covar_bins Integer scalar. When positive, covariates are snapped
+//' to this number of quantile bins before initializing the model (see
+//' details).
+//' @details
+//' With `covar_bins > 0`, each covariate with more than `covar_bins`
+//' distinct values is split into `covar_bins` quantile bins, and its values
+//' are replaced by the mean of their bin. Arrays with close covariate values
+//' then share their support sets, which can reduce their number by orders
+//' of magnitude when continuous covariates are interacted with terms. The
+//' model is then the model of the quantized covariates (including the
+//' observed statistics); [covar_bins_error()] estimates how far its
+//' log-likelihood is from the exact one. Models initialized this way are
+//' used as any other; adding terms initializes them again.
 //' @export
 // [[Rcpp::export(invisible = true, rng = false)]]
-SEXP init_defm(SEXP m, bool force_new = false)
+SEXP init_defm(
+  SEXP m,
+  bool force_new = false,
+  int ncores = 1,
+  bool factor_covar = false,
+  int covar_bins = 0
+)
 {
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
-  ptr->init(force_new);
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+
+  DEFMProfile * profile = as_profile(m);
+  profile->reset_init();
+  DEFMTimer timer(&profile->time_init);
+
+  if (factor_covar && force_new)
+    stop("-force_new- and -factor_covar- cannot be used together.");
+
+  if ((covar_bins != 0) && (force_new || factor_covar))
+    stop("-covar_bins- cannot be used with -force_new- or -factor_covar-.");
+
+  if (covar_bins < 0)
+    stop("-covar_bins- must be a positive integer (or zero.)");
+
+  if (covar_bins > 0)
+  {
+
+    Rcpp::XPtr< DEFMSupportStore > store(new DEFMSupportStore(), true);
+    store->program = defm_compile_checked(*ptr, *as_term_specs(m, *ptr));
+    defm_init_quantized(
+      *ptr, *store, ncores, static_cast< size_t >(covar_bins),
+      []() -> void {Rcpp::checkUserInterrupt();},
+      profile
+      );
+
+    Rf_setAttrib(m, Rf_install("native_init"), store);
+
+  } else if (factor_covar)
+  {
+
+    Rcpp::XPtr< DEFMSupportStore > store(new DEFMSupportStore(), true);
+    store->program = defm_compile_checked(*ptr, *as_term_specs(m, *ptr));
+    defm_init_factored(
+      *ptr, *store, ncores,
+      []() -> void {Rcpp::checkUserInterrupt();},
+      profile
+      );
+
+    Rf_setAttrib(m, Rf_install("native_init"), store);
+
+  } else {
+
+    // Whatever the number of threads, so the supports are walked in
+    // Gray-code order (or pruned by the rules) whenever the terms compile,
+    // and the model works the same way. Terms or rules that do not compile
+    // are enumerated with barry's support function instead.
+    Rcpp::XPtr< DEFMSupportStore > store(new DEFMSupportStore(), true);
+    store->program = defm_compile_checked(*ptr, *as_term_specs(m, *ptr));
+    defm_init_parallel(
+      *ptr, *store, force_new, ncores,
+      []() -> void {Rcpp::checkUserInterrupt();},
+      profile
+      );
+
+    Rf_setAttrib(m, Rf_install("native_init"), store);
+
+  }
+
+  timer.stop();
+  profile->init_ncores = std::max(ncores, 1);
+
   return m;
 }
 
 
+// barry's print() describes the supports it holds, which are empty when the
+// model was initialized natively (see init_defm()), so the same summary is
+// printed from the store instead.
+static void print_native_init(
+  SEXP m,
+  defm::DEFM & model,
+  const DEFMSupportStore & store
+) {
+
+  size_t min_v = 0u, max_v = 0u, pset = 0u;
+  for (size_t s = 0u; s < store.n_support(); ++s)
+  {
+
+    const size_t n = store.support_nrow[s];
+    min_v = (s == 0u) ? n : std::min(min_v, n);
+    max_v = std::max(max_v, n);
+    pset += store.rows[s].size();
+
+  }
+
+  Rprintf("Num. of Arrays       : %lu\n", static_cast< unsigned long >(store.n_arrays()));
+  Rprintf("Support size         : %lu\n", static_cast< unsigned long >(store.n_support()));
+  Rprintf(
+    "Support size range   : [%lu, %lu]\n",
+    static_cast< unsigned long >(min_v), static_cast< unsigned long >(max_v)
+    );
+  Rprintf("Arrays in powerset   : %lu\n", static_cast< unsigned long >(pset));
+  Rprintf("Initialization       : native (%i thread(s))\n", store.ncores);
+
+  const auto terms = model.colnames();
+  Rprintf("Model terms (%lu)    :\n", static_cast< unsigned long >(terms.size()));
+  for (const auto & t : terms)
+    Rprintf(" - %s\n", t.c_str());
+
+  const DEFMTermSpecs * specs = as_term_specs(m, model);
+  const size_t nrules = specs->absorbing.size() + specs->bounds.size();
+  if (nrules > 0u)
+  {
+
+    Rprintf("Model rules (%lu)     :\n", static_cast< unsigned long >(nrules));
+    for (const auto & y : specs->absorbing)
+      Rprintf(" - Not one to zero (outcome %lu)\n", static_cast< unsigned long >(y));
+
+    for (const auto & b : specs->bounds)
+      Rprintf(
+        " - Constrain support (term %lu in [%.2f, %.2f])\n",
+        static_cast< unsigned long >(b.term), b.lb, b.ub
+        );
+
+  }
+
+  const auto & y_names = model.get_Y_names();
+  Rprintf("Model Y variables (%i):\n", static_cast< int >(y_names.size()));
+  for (size_t y = 0u; y < y_names.size(); ++y)
+    Rprintf("  % 2i) %s\n", static_cast< int >(y), y_names[y].c_str());
+
+}
+
 // [[Rcpp::export(invisible = true, rng = false, name = "print_defm_cpp")]]
 SEXP print_defm(SEXP x)
 {
 
   Rcpp::XPtr< defm::DEFM > ptr(x);
 
+  if (const DEFMSupportStore * store = as_native_init(x))
+  {
+    print_native_init(x, *ptr, *store);
+    return x;
+  }
+
   ptr->print();
 
   return x;
@@ -211,14 +426,132 @@ SEXP print_defm(SEXP x)
 }
 
 
+// Contribution of each observation (or id) to the log-likelihood: the
+// log normalizing constants are computed once per support, then each
+// array adds its own term.
+inline NumericVector loglike_defm_by(
+    SEXP m,
+    const std::vector< double > & par,
+    bool as_log,
+    bool by_id,
+    int ncores
+  )
+{
+
+  DEFMLikelihood loglike = get_likelihood(m);
+  DEFMArrayView arrays   = get_array_view(m);
+
+  const size_t k = loglike.k;
+  if (par.size() != k)
+    stop(
+      "The length of -par- (" + std::to_string(par.size()) +
+      ") does not match the number of terms (" +
+      std::to_string(k) + ")."
+      );
+
+  if (arrays.target.size() == 0u)
+    stop("The model has not been initialized. Use init_defm() first.");
+
+  std::vector< double > logz(loglike.size());
+  loglike.log_normalizers(&par[0u], logz.data(), ncores);
+
+  std::vector< int > rows;
+  rows2arrays(arrays.ID, arrays.m_order, 0u, arrays.n_rows, rows);
+
+  const size_t nrows = arrays.n_rows;
+  NumericVector res(nrows);
+  double * out = res.begin();
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  #ifdef _OPENMP
+  #pragma omp parallel for num_threads(ncores) schedule(static)
+  #endif
+  for (size_t i = 0u; i < nrows; ++i)
+  {
+
+    if (rows[i] < 0)
+    {
+      out[i] = NA_REAL;
+      continue;
+    }
+
+    const double * t = arrays.target[rows[i]];
+
+    double ll = -logz[arrays.entry[rows[i]]];
+    for (size_t j = 0u; j < k; ++j)
+      ll += par[j] * t[j];
+
+    out[i] = ll;
+
+  }
+
+  if (!by_id)
+  {
+
+    if (!as_log)
+      for (auto & r : res)
+        r = std::exp(r);
+
+    return res;
+
+  }
+
+  // Adding up by id (rows of an id are contiguous)
+  std::vector< double > total;
+  std::vector< std::string > ids;
+  for (size_t i = 0u; i < nrows; ++i)
+  {
+
+    if ((i == 0u) || (arrays.ID[i] != arrays.ID[i - 1u]))
+    {
+      total.push_back(0.0);
+      ids.push_back(std::to_string(arrays.ID[i]));
+    }
+
+    if (rows[i] >= 0)
+      total.back() += res[i];
+
+  }
+
+  if (!as_log)
+    for (auto & r : total)
+      r = std::exp(r);
+
+  NumericVector ans = wrap(total);
+  ans.names() = wrap(ids);
+
+  return ans;
+
+}
+
 //' Log-Likelihood of DEFM
 //'
 //' @param m An object of class [DEFM]
 //' @param par A vector of parameters of length `nterms_defm(m)`.
 //' @param as_log Logical scalar. When `TRUE` (default) returns the log-likelihood,
 //' otherwise it returns the likelihood.
+//' @param by Character scalar. One of `"total"` (default), `"obs"`, or
+//' `"id"` (see details).
+//' @param ncores Integer scalar. Number of threads to use when OpenMP is
+//' available.
+//' @details
+//' With `by = "obs"` or `by = "id"`, `loglike_defm` returns the contribution
+//' of each observation (row of the data) or each id to the log-likelihood,
+//' computed in a single pass over the support sets. The contribution of an
+//' observation is its sufficient statistics times `par` minus the log
+//' normalizing constant of its support. Rows within the Markov order of
+//' each id, which have no contribution, are `NA`, as in [get_stats()]. These
+//' are useful for model checking (e.g., WAIC and PSIS-LOO) and influence
+//' diagnostics. The model must be initialized with [init_defm()].
 //' @return
-//' Numeric, the computed likelihood or log-likelihood of the model.
+//' Numeric, the computed likelihood or log-likelihood of the model. With
+//' `by = "obs"`, a vector of length `nrow_defm(m)`; with `by = "id"`, a
+//' named vector with one element per id (in order of appearance.)
 //' @export
 //' @examples
 //' # Loading Valtente's SNS data
@@ -237,18 +570,204 @@ SEXP print_defm(SEXP x)
 //'
 //' # Computing the log-likelihood
 //' loglike_defm(mymodel, par = c(-1, -1, -1, 2), as_log = TRUE)
+//'
+//' # Contribution of each id
+//' init_defm(mymodel)
+//' head(loglike_defm(mymodel, par = c(-1, -1, -1, 2), by = "id"))
+// [[Rcpp::export(rng = false)]]
+NumericVector loglike_defm(
+    SEXP m,
+    std::vector< double > par,
+    bool as_log = true,
+    std::string by = "total",
+    int ncores = 1
+  )
+{
+
+  if ((by != "total") && (by != "obs") && (by != "id"))
+    stop("-by- must be one of \"total\", \"obs\", or \"id\".");
+
+  DEFMProfile * profile = as_profile(m);
+  DEFMTimer timer(profile ? &profile->time_likelihood : nullptr);
+  if (profile)
+    profile->n_likelihood++;
+
+  if (by != "total")
+    return loglike_defm_by(m, par, as_log, by == "id", ncores);
+
+  double res;
+  if ((as_mapped(m) != nullptr) || (as_native_init(m) != nullptr))
+  {
+
+    DEFMLikelihood loglike = get_likelihood(m);
+
+    if (par.size() != loglike.k)
+      stop(
+        "The length of -par- (" + std::to_string(par.size()) +
+        ") does not match the number of terms (" +
+        std::to_string(loglike.k) + ")."
+        );
+
+    res = loglike.eval(&par[0u], nullptr, nullptr, ncores);
+    if (!as_log)
+      res = std::exp(res);
+
+  } else {
+
+    Rcpp::XPtr< defm::DEFM > ptr(m);
+    res = ptr->likelihood_total(par, as_log);
+
+  }
+
+  if (!std::isfinite(res))
+    res = R_NegInf;
+
+  return NumericVector::create(res);
+
+}
+
+//' @rdname loglike_defm
+//' @details
+//' `loglike_grad_defm` computes the log-likelihood together with its exact
+//' gradient, i.e., the observed minus the expected sufficient statistics
+//' under each support, in a single pass over the support sets. The model
+//' must be initialized with [init_defm()].
+//' @returns
+//' - `loglike_grad_defm` returns the log-likelihood with the gradient stored
+//' in the attribute `"gradient"`.
+//' @export
 // [[Rcpp::export(rng = false)]]
-double loglike_defm(SEXP m, std::vector< double > par, bool as_log = true)
+NumericVector loglike_grad_defm(
+    SEXP m,
+    const std::vector< double > & par,
+    int ncores = 1
+  )
 {
 
-  Rcpp::XPtr< defm::DEFM > ptr(m);
+  DEFMProfile * profile = as_profile(m);
+  DEFMTimer timer(profile ? &profile->time_likelihood : nullptr);
+  if (profile)
+    profile->n_likelihood++;
 
-  double res = ptr->likelihood_total(par, as_log);
+  std::vector< std::string > pnames;
+  DEFMLikelihood loglike = get_likelihood(m, &pnames);
 
-  if (std::isfinite(res))
-    return res;
-  else
-    return R_NegInf;
+  if (par.size() != loglike.k)
+    stop(
+      "The length of -par- (" + std::to_string(par.size()) +
+      ") does not match the number of terms (" +
+      std::to_string(loglike.k) + ")."
+      );
+
+  NumericVector grad(par.size());
+  double res = loglike.eval(&par[0u], &grad[0u], nullptr, ncores);
+  timer.stop();
+
+  if (!std::isfinite(res))
+    res = R_NegInf;
+
+  grad.names() = wrap(pnames);
+
+  NumericVector ans = NumericVector::create(res);
+  ans.attr("gradient") = grad;
+
+  return ans;
+
+}
+
+//' @rdname loglike_defm
+//' @details
+//' `hessian_defm` computes the exact Hessian of the log-likelihood, which,
+//' for a DEFM, is minus the sum across arrays of the covariance of the
+//' sufficient statistics under each support. Its negative inverse evaluated
+//' at the MLE is the asymptotic variance-covariance matrix of the estimates.
+//' @returns
+//' - `hessian_defm` returns a square matrix of size `nterms_defm(m)`.
+//' @export
+// [[Rcpp::export(rng = false)]]
+NumericMatrix hessian_defm(
+    SEXP m,
+    const std::vector< double > & par,
+    int ncores = 1
+  )
+{
+
+  DEFMProfile * profile = as_profile(m);
+  DEFMTimer timer(profile ? &profile->time_likelihood : nullptr);
+  if (profile)
+    profile->n_likelihood++;
+
+  std::vector< std::string > pnames;
+  DEFMLikelihood loglike = get_likelihood(m, &pnames);
+
+  size_t k = loglike.k;
+  if (par.size() != k)
+    stop(
+      "The length of -par- (" + std::to_string(par.size()) +
+      ") does not match the number of terms (" +
+      std::to_string(k) + ")."
+      );
+
+  // NumericMatrix is column-major, as the Hessian computed by eval()
+  NumericMatrix res(k, k);
+  loglike.eval(&par[0u], nullptr, &res[0u], ncores);
+  timer.stop();
+
+  CharacterVector cnames = wrap(pnames);
+  rownames(res) = cnames;
+  colnames(res) = cnames;
+
+  return res;
+
+}
+
+//' @rdname loglike_defm
+//' @details
+//' `loglike_defm_batch` evaluates many parameter vectors at once, e.g., for
+//' profile likelihoods, grid searches, or multiple starting points. There,
+//' `par` is a matrix with one row per parameter vector and one column per
+//' term. The support sets are read once for the whole batch, and the
+//' exponentials are computed several vectors at a time, so the cost still
+//' grows linearly with the number of vectors, but each one costs a fraction
+//' of a separate call (e.g., about a fourth of it with hundreds of vectors).
+//' The model must be initialized with [init_defm()].
+//' @returns
+//' - `loglike_defm_batch` returns a numeric vector with the log-likelihood
+//' of each row of `par`.
+//' @export
+// [[Rcpp::export(rng = false)]]
+NumericVector loglike_defm_batch(
+    SEXP m,
+    const NumericMatrix & par,
+    int ncores = 1
+  )
+{
+
+  DEFMProfile * profile = as_profile(m);
+  DEFMTimer timer(profile ? &profile->time_likelihood : nullptr);
+  if (profile)
+    profile->n_likelihood += static_cast< uint64_t >(par.nrow());
+
+  DEFMLikelihood loglike = get_likelihood(m);
+
+  if (static_cast< size_t >(par.ncol()) != loglike.k)
+    stop(
+      "The number of columns of -par- (" + std::to_string(par.ncol()) +
+      ") does not match the number of terms (" +
+      std::to_string(loglike.k) + ")."
+      );
+
+  // NumericMatrix is column-major, i.e., term by term as eval_batch() takes
+  NumericVector res(par.nrow());
+  if (par.nrow() > 0)
+    loglike.eval_batch(&par[0u], par.nrow(), &res[0u], ncores);
+  timer.stop();
+
+  for (auto & r : res)
+    if (!std::isfinite(r))
+      r = R_NegInf;
+
+  return res;
 
 }
 
@@ -258,6 +777,9 @@ double loglike_defm(SEXP m, std::vector< double > par, bool as_log = true)
 //' @param par Numeric vector of model parameters.
 //' @param fill_t0 Logical scalar. When `TRUE` (default) will fill-in the baseline
 //' value of each observation (i.e., the starting condition) (see details.)
+//' @param nsim Integer scalar. Number of replicates to simulate.
+//' @param ncores Integer scalar. Number of threads to use when OpenMP is
+//' available.
 //'
 //' @details
 //' Each observation in the simulation must have initial condition. In practice,
@@ -267,56 +789,70 @@ double loglike_defm(SEXP m, std::vector< double > par, bool as_log = true)
 //' the rows corresponding to baseline states with the original value, otherwise
 //' it replaces them with -1. This option is mostly for testing purposes.
 //'
-//' @returns An integer vector of size `nrows_defm(m) x ncol_defm_y(m)`.
+//' Replicates are simulated in parallel. The random numbers are generated
+//' from a single seed (drawn from R's RNG) using a counter-based generator
+//' indexed by replicate and row, so the results are the same regardless of
+//' the number of threads, and the first replicate of `nsim > 1` matches the
+//' result with `nsim = 1`. The support sets of the arrays generated during
+//' the simulation are shared across replicates.
+//'
+//' @returns An integer matrix of size `nrows_defm(m) x ncol_defm_y(m)`. If
+//' `nsim > 1`, an integer array of size
+//' `nrows_defm(m) x ncol_defm_y(m) x nsim`.
 //' @export
 // [[Rcpp::export(rng = true)]]
-IntegerMatrix sim_defm(
+SEXP sim_defm(
     SEXP m,
     std::vector< double > par,
-    bool fill_t0 = true
+    bool fill_t0 = true,
+    int nsim = 1,
+    int ncores = 1
   )
 {
 
-  size_t seed = static_cast<size_t>(
-    R::unif_rand() * static_cast<double>(std::numeric_limits< size_t >::max())
-  );
+  if (nsim < 1)
+    stop("-nsim- must be a positive integer.");
 
+  uint64_t seed = draw_seed();
 
   Rcpp::XPtr< defm::DEFM > ptr(m);
 
-  ptr->set_seed(seed);
+  if (par.size() != ptr->nterms())
+    stop(
+      "The length of -par- (" + std::to_string(par.size()) +
+      ") does not match the number of terms (" +
+      std::to_string(ptr->nterms()) + ")."
+      );
 
   size_t nrows = ptr->get_n_rows();
   size_t ncols = ptr->get_n_y();
 
-  std::vector< int > out(nrows * ncols, -1);
-  ptr->simulate(par, &(out[0u]));
+  // Written straight into R's memory (column-major)
+  IntegerVector res(nrows * ncols * static_cast< size_t >(nsim));
 
-  IntegerMatrix res(nrows, ncols);
+  DEFMSimSupport supports(*ptr, par);
+  defm_simulate(
+    *ptr, supports, seed, static_cast< size_t >(nsim), fill_t0,
+    res.begin(), ncores,
+    []() -> void {Rcpp::checkUserInterrupt();}
+  );
 
-  size_t iter = 0u;
-  const int * Y = ptr->get_Y();
-  for (size_t i = 0u; i < nrows; ++i)
-  {
+  // Adding a name
+  CharacterVector names = wrap(ptr->get_Y_names());
 
-    for (size_t j = 0u; j < ncols; ++j)
-    {
+  if (nsim == 1)
+  {
 
-      if (fill_t0 & (out[iter] == -1))
-        res(i, j) = *(Y + j * nrows + i); // Column wise
-      else
-        res(i, j) = out[iter]; // But the simulation is row wise
+    res.attr("dim") = IntegerVector::create(nrows, ncols);
+    res.attr("dimnames") = List::create(R_NilValue, names);
 
-      iter++;
+  } else {
 
-    }
+    res.attr("dim") = IntegerVector::create(nrows, ncols, nsim);
+    res.attr("dimnames") = List::create(R_NilValue, names, R_NilValue);
 
   }
 
-  // Adding a name
-  CharacterVector names = wrap(ptr->get_Y_names());
-  Rcpp::colnames(res) = names;
-
   return res;
 }
 
@@ -330,8 +866,48 @@ IntegerMatrix sim_defm(
 // [[Rcpp::export(rng = false, invisible = true)]]
 int print_stats(SEXP m, int i = 0)
 {
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
-  ptr->print_stats(static_cast< size_t >(i));
+
+  const DEFMSupportStore * store = as_native_init(m);
+  if (store == nullptr)
+  {
+    ptr->print_stats(static_cast< size_t >(i));
+    return 0;
+  }
+
+  // Same layout as barry's: the weight of each row and its statistics (for
+  // factored models, times the multipliers of the array)
+  if ((i < 0) || (static_cast< size_t >(i) >= store->n_arrays()))
+    stop("The requested support is out of range.");
+
+  const size_t a = static_cast< size_t >(i);
+  const size_t s = store->arrays2support[a];
+  const size_t k = store->k;
+
+  size_t offset = 0u;
+  for (size_t l = 0u; l < s; ++l)
+    offset += store->support_nrow[l] * (k + 1u);
+
+  const double * S     = store->support.data() + offset;
+  const double * scale = store->factored ?
+    &store->group_scale[store->arrays2group[a] * k] : nullptr;
+
+  for (size_t l = 0u; l < store->support_nrow[s]; ++l)
+  {
+
+    Rprintf("% 5lu ", static_cast< unsigned long >(l));
+    Rprintf("counts: %.0f motif: ", S[l * (k + 1u)]);
+
+    for (size_t j = 0u; j < k; ++j)
+      Rprintf(
+        "%.2f, ",
+        S[l * (k + 1u) + j + 1u] * (scale != nullptr ? scale[j] : 1.0)
+        );
+
+    Rprintf("\n");
+
+  }
 
   return 0;
 }
@@ -343,6 +919,9 @@ int print_stats(SEXP m, int i = 0)
 int nterms_defm(SEXP m)
 {
 
+  if (const DEFMMapped * mapped = as_mapped(m))
+    return mapped->header.k;
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
   return ptr->nterms();
 }
@@ -352,6 +931,9 @@ int nterms_defm(SEXP m)
 CharacterVector names_defm(SEXP x)
 {
 
+  if (const DEFMMapped * mapped = as_mapped(x))
+    return wrap(mapped->term_names);
+
   Rcpp::XPtr< defm::DEFM > ptr(x);
   return wrap(ptr->colnames());
 }
@@ -362,6 +944,10 @@ CharacterVector names_defm(SEXP x)
 // [[Rcpp::export(rng = false)]]
 int nrow_defm(SEXP m)
 {
+
+  if (const DEFMMapped * mapped = as_mapped(m))
+    return mapped->header.n_rows;
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
   return ptr->get_n_rows();
 }
@@ -374,6 +960,9 @@ int nrow_defm(SEXP m)
 int ncol_defm_y(SEXP m)
 {
 
+  if (const DEFMMapped * mapped = as_mapped(m))
+    return mapped->header.n_y;
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
 
   return ptr->get_n_y();
@@ -387,6 +976,9 @@ int ncol_defm_y(SEXP m)
 int ncol_defm_x(SEXP m)
 {
 
+  if (const DEFMMapped * mapped = as_mapped(m))
+    return mapped->header.n_x;
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
 
   return ptr->get_n_covars();
@@ -401,6 +993,9 @@ int ncol_defm_x(SEXP m)
 int nobs_defm(SEXP m)
 {
 
+  if (const DEFMMapped * mapped = as_mapped(m))
+    return mapped->header.n_obs;
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
 
   return ptr->get_n_obs();
@@ -414,6 +1009,9 @@ int nobs_defm(SEXP m)
 int morder_defm(SEXP m)
 {
 
+  if (const DEFMMapped * mapped = as_mapped(m))
+    return mapped->header.m_order;
+
   Rcpp::XPtr< defm::DEFM > ptr(m);
 
   return ptr->get_m_order();
@@ -425,6 +1023,25 @@ int morder_defm(SEXP m)
 //' This function computes the individual counts of the sufficient statistics
 //' included in the model. 
 //' @param m An object of class [DEFM].
+//' @param from,to Integer scalars. First and last rows (1-indexed) to
+//' retrieve. By default, all rows. Use them to read the statistics of large
+//' models in chunks (see details.)
+//' @details
+//' The statistics are read directly from the model and written into the
+//' returned matrix, without copying them. The first call also maps each row
+//' to its array and keeps that map with the model, so reading by chunks does
+//' not scan the rows before each chunk.
+//' For models with many rows, the statistics can be retrieved by chunks, for
+//' instance:
+//' 
+//' ```
+//' n <- nrow_defm(m)
+//' for (from in seq(1, n, by = 1e5))
+//'   process(get_stats(m, from = from, to = min(from + 1e5 - 1, n)))
+//' ```
+//' 
+//' Rows that correspond to the starting condition of each observation (the
+//' first `morder_defm(m)` rows) are filled with `NA`.
 //' @export
 //' @return A matrix with the counts of the sufficient statistics.
 //' @examples
@@ -446,88 +1063,235 @@ int morder_defm(SEXP m)
 //' 
 //' # Get the counts
 //' head(get_stats(mymodel))
+//' 
+//' # Only rows 11 to 20
+//' get_stats(mymodel, from = 11, to = 20)
 // [[Rcpp::export(rng = false)]]
-NumericMatrix get_stats(SEXP m)
+NumericMatrix get_stats(SEXP m, int from = 1, int to = -1)
 {
 
-  Rcpp::XPtr< defm::DEFM > ptr(m);
+  // Reading the statistics directly from the model (no copies). Models
+  // loaded with load_defm() store them as a flat (n_arrays x k) matrix.
+  const DEFMMapped * mapped = as_mapped(m);
 
-  auto model = ptr->get_model();
+  const std::vector< std::vector< double > > * target = nullptr;
+  const int * ID;
+  size_t m_ord, ncols, n_arrays;
+  int nrows_total;
+  std::vector< std::string > pnames;
 
-  // Getting sizes
-  size_t nrows = ptr->get_n_rows();
-  size_t ncols = model.nterms();
-  size_t m_ord = ptr->get_m_order();
+  if (mapped != nullptr)
+  {
 
-  const int * ID = ptr->get_ID();
+    ID          = mapped->ID();
+    m_ord       = mapped->header.m_order;
+    ncols       = mapped->header.k;
+    n_arrays    = mapped->header.n_arrays;
+    nrows_total = static_cast< int >(mapped->header.n_rows);
+    pnames      = mapped->term_names;
 
-  NumericMatrix res(nrows, ncols);
-  auto target = model.get_stats_target();
+  } else {
 
+    Rcpp::XPtr< defm::DEFM > ptr(m);
 
-  size_t i_effective = 0u;
-  size_t n_obs_i = 0u;
-  for (size_t i = 0u; i < nrows; ++i)
+    target      = ptr->get_stats_target();
+    ID          = ptr->get_ID();
+    m_ord       = ptr->get_m_order();
+    ncols       = ptr->nterms();
+    n_arrays    = target->size();
+    nrows_total = static_cast< int >(ptr->get_n_rows());
+    pnames      = ptr->colnames();
+
+  }
+
+  // Models initialized natively store the statistics as mapped ones do
+  const DEFMSupportStore * store = as_native_init(m);
+  const double * target_flat     = (mapped != nullptr) ?
+    mapped->target() : nullptr;
+
+  if (store != nullptr)
   {
 
-    // Do we need to reset the counter?
-    if ((i > 0) && (*(ID + i - 1u) != *(ID + i)))
-      n_obs_i = 0u;
+    if (store->k != ncols)
+      stop("The terms of the model changed after init_defm(). Initialize it again.");
+
+    n_arrays    = store->n_arrays();
+    target_flat = store->target.data();
+
+  }
+
+  if (n_arrays == 0u)
+    stop("The model has not been initialized. Use init_defm() first.");
+
+  // Getting sizes
+  if (to < 0)
+    to = nrows_total;
+
+  if ((from < 1) || (to > nrows_total) || (from > to))
+    stop(
+      "Invalid range of rows. -from- and -to- must satisfy 1 <= from <= to <= " +
+      std::to_string(nrows_total) + "."
+    );
+
+  size_t nrows = static_cast< size_t >(to - from + 1);
+
+  const int * arrays = as_row_arrays(
+    m, ID, m_ord, static_cast< size_t >(nrows_total)
+  )->data() + (from - 1);
+
+  // Filling column by column directly into R's memory
+  NumericMatrix res(nrows, ncols);
+  for (size_t j = 0u; j < ncols; ++j)
+  {
 
-    // Did we passed the Markov order?
-    if (n_obs_i++ < m_ord)
+    double * col = res.begin() + j * nrows;
+    for (size_t i = 0u; i < nrows; ++i)
     {
-      std::fill(res.row(i).begin(), res.row(i).end(), NA_REAL);
-      continue;
-    }
 
-    for (size_t j = 0u; j < ncols; ++j)
-      res(i, j) = (*target)[i_effective][j];
+      if (arrays[i] < 0)
+        col[i] = NA_REAL;
+      else if (target_flat != nullptr)
+        col[i] = target_flat[arrays[i] * ncols + j];
+      else
+        col[i] = (*target)[arrays[i]][j];
 
-    i_effective++;
+    }
 
   }
 
   // Setting the names
-  Rcpp::CharacterVector cnames(0);
-  for (auto & n : model.colnames())
-    cnames.push_back(n);
+  Rcpp::CharacterVector cnames = wrap(pnames);
   Rcpp::colnames(res) = cnames;
 
   return res;
 
 }
 
+// Column names of the census of the outcomes `locs`
+static Rcpp::CharacterVector motif_census_names(
+  const std::vector< size_t > & locs,
+  size_t m_order
+) {
+
+  Rcpp::CharacterVector cnames = {"count"};
+  for (size_t m = 0u; m < (m_order + 1); ++m)
+  {
+    for (auto & n : locs)
+      cnames.push_back(
+        std::string("y") + std::to_string(m) + std::to_string(n)
+      );
+  }
+
+  return cnames;
+
+}
+
 // [[Rcpp::export(rng = false)]]
-NumericMatrix motif_census_cpp(SEXP m, std::vector<size_t> locs)
+List motif_census_cpp(SEXP m, Rcpp::List locs, int ncores = 1)
 {
 
-  Rcpp::XPtr< defm::DEFM > ptr(m);
+  std::vector< std::vector< size_t > > sets(locs.size());
+  for (R_xlen_t s = 0; s < locs.size(); ++s)
+    sets[s] = Rcpp::as< std::vector< size_t > >(locs[s]);
 
-  barry::FreqTable<int> res = ptr->motif_census(locs);
-  auto dat = res.get_data();
+  const int * Y;
+  const int * ID;
+  size_t n_rows, n_y, m_order;
+  defm::DEFM * model = nullptr;
 
-  size_t nele = res.size();
-  NumericMatrix m_res(nele, locs.size() * (ptr->get_m_order() + 1) + 1);
+  if (const DEFMMapped * mapped = as_mapped(m))
+  {
+    Y       = mapped->Y();
+    ID      = mapped->ID();
+    n_rows  = mapped->header.n_rows;
+    n_y     = mapped->header.n_y;
+    m_order = mapped->header.m_order;
+  }
+  else
+  {
+    Rcpp::XPtr< defm::DEFM > ptr(m);
+    model   = &(*ptr);
+    Y       = ptr->get_Y();
+    ID      = ptr->get_ID();
+    n_rows  = ptr->get_n_rows();
+    n_y     = ptr->get_n_y();
+    m_order = ptr->get_m_order();
+  }
 
-  size_t ele = 0u;
-  for (size_t i = 0u; i < nele; ++i)
-    for (size_t j = 0u; j < (locs.size() * (ptr->get_m_order() + 1) + 1); ++j)
-      m_res(i, j) = dat[ele++];
+  // Sets with motifs too large for a 64-bit key go through barry's census
+  std::vector< std::vector< size_t > > packed;
+  std::vector< size_t > packed_idx;
+  for (size_t s = 0u; s < sets.size(); ++s)
+  {
 
-  // Setting the names
-  Rcpp::CharacterVector cnames = {"count"};
-  for (size_t m = 0u; m < (ptr->get_m_order() + 1); ++m)
+    if (defm_motif_ncells(sets[s], n_y, m_order) > DEFM_MOTIF_MAX_CELLS)
+    {
+
+      if (model == nullptr)
+        stop(
+          "Motifs can have at most %i cells with models loaded from a file.",
+          DEFM_MOTIF_MAX_CELLS
+        );
+
+      continue;
+
+    }
+
+    packed.push_back(sets[s]);
+    packed_idx.push_back(s);
+
+  }
+
+  std::vector< DEFMMotifCensus > census = defm_motif_census(
+    Y, ID, n_rows, n_y, m_order, packed, ncores
+  );
+
+  List res(sets.size());
+  for (size_t p = 0u; p < packed.size(); ++p)
   {
-    for (auto & n : locs)
-      cnames.push_back(
-        std::string("y") + std::to_string(m) + std::to_string(n)
-      );
+
+    const DEFMMotifCensus & cen = census[p];
+    const size_t nele = cen.keys.size();
+
+    IntegerMatrix m_res(nele, cen.ncells + 1u);
+    std::copy(cen.counts.begin(), cen.counts.end(), m_res.begin());
+
+    for (size_t c = 0u; c < cen.ncells; ++c)
+    {
+      int * col = m_res.begin() + (c + 1u) * nele;
+      for (size_t i = 0u; i < nele; ++i)
+        col[i] = cen.cell(i, c);
+    }
+
+    Rcpp::colnames(m_res) = motif_census_names(packed[p], m_order);
+    res[packed_idx[p]] = m_res;
+
   }
 
-  Rcpp::colnames(m_res) = cnames;
+  for (size_t s = 0u; s < sets.size(); ++s)
+  {
+
+    if (!Rf_isNull(res[s]))
+      continue;
+
+    barry::FreqTable<int> tab = model->motif_census(sets[s]);
+    auto dat = tab.get_data();
+
+    const size_t nele  = tab.size();
+    const size_t ncols = sets[s].size() * (m_order + 1) + 1;
+    IntegerMatrix m_res(nele, ncols);
+
+    size_t ele = 0u;
+    for (size_t i = 0u; i < nele; ++i)
+      for (size_t j = 0u; j < ncols; ++j)
+        m_res(i, j) = dat[ele++];
+
+    Rcpp::colnames(m_res) = motif_census_names(sets[s], m_order);
+    res[s] = m_res;
 
-  return m_res;
+  }
+
+  return res;
 
 }
 
@@ -551,7 +1315,103 @@ NumericVector logodds(
 
   Rcpp::XPtr< defm::DEFM > ptr(m);
 
-  return wrap(ptr->logodds(par, static_cast<size_t>(i), static_cast<size_t>(j)));
+  const size_t nrows   = ptr->get_n_rows();
+  const size_t n_y     = ptr->get_n_y();
+  const size_t m_order = ptr->get_m_order();
+
+  if ((static_cast< size_t >(i) > m_order) || (static_cast< size_t >(j) >= n_y))
+    stop(
+      "The cell (" + std::to_string(i) + ", " + std::to_string(j) +
+      ") is out of the array (" + std::to_string(m_order + 1u) + " x " +
+      std::to_string(n_y) + ")."
+      );
+
+  if (par.size() != ptr->nterms())
+    stop(
+      "The length of -par- (" + std::to_string(par.size()) +
+      ") does not match the number of terms (" +
+      std::to_string(ptr->nterms()) + ")."
+      );
+
+  // Same computation as logodds_all(), for one cell, so it does not depend
+  // on how (or whether) the model was initialized
+  NumericVector res(nrows);
+  defm_logodds_cells(
+    *ptr, par, {static_cast< size_t >(j) + static_cast< size_t >(i) * n_y},
+    res.begin(), 1
+  );
+
+  return res;
+
+}
+
+//' @param ncores Integer scalar. Number of threads to use when OpenMP is
+//' available.
+//' @details
+//' `logodds_all` computes the log-odds of every cell of every observation's
+//' array at once, i.e., the same as calling `logodds` for each `i` in
+//' `0:morder_defm(m)` and each `j` in `0:(ncol_defm_y(m) - 1)`, in a single
+//' parallel pass over the data. For each observation, the statistics of its
+//' observed array are computed once and each cell only requires counting
+//' the array with that cell toggled. It does not require initializing the
+//' model.
+//' @return - `logodds_all` returns a numeric array of size
+//' `nrow_defm(m) x ncol_defm_y(m) x (morder_defm(m) + 1)`, where
+//' `[, j + 1, i + 1]` matches `logodds(m, par, i, j)`. Rows within the
+//' Markov order of each id are `NA`.
+//' @rdname defm_mle
+//' @export
+// [[Rcpp::export(rng = false)]]
+NumericVector logodds_all(
+    SEXP m,
+    const std::vector< double > & par,
+    int ncores = 1
+) {
+
+  Rcpp::XPtr< defm::DEFM > ptr(m);
+
+  const size_t nrows   = ptr->get_n_rows();
+  const size_t n_y     = ptr->get_n_y();
+  const size_t m_order = ptr->get_m_order();
+
+  if (par.size() != ptr->nterms())
+    stop(
+      "The length of -par- (" + std::to_string(par.size()) +
+      ") does not match the number of terms (" +
+      std::to_string(ptr->nterms()) + ")."
+      );
+
+  // Written straight into R's memory
+  NumericVector res(nrows * n_y * (m_order + 1u));
+  defm_logodds_all(*ptr, par, res.begin(), ncores);
+
+  // Rows within the Markov order have no array: NA instead of NaN. Other
+  // NaNs (e.g., from overflowing parameters) are kept as such.
+  const std::vector< int > & arrays = *as_row_arrays(
+    m, ptr->get_ID(), m_order, nrows
+  );
+
+  for (size_t i = 0u; i < nrows; ++i)
+  {
+
+    if (arrays[i] >= 0)
+      continue;
+
+    for (size_t c = 0u; c < (n_y * (m_order + 1u)); ++c)
+      res[i + c * nrows] = NA_REAL;
+
+  }
+
+  CharacterVector tnames(m_order + 1u);
+  for (size_t t = 0u; t <= m_order; ++t)
+    tnames[t] = "t" + std::to_string(t);
+
+  res.attr("dim") = IntegerVector::create(nrows, n_y, m_order + 1u);
+  res.attr("dimnames") = List::create(
+    R_NilValue, wrap(ptr->get_Y_names()), tnames
+  );
+
+  return res;
 
 }
 
@@ -564,3 +1424,217 @@ LogicalVector is_motif(SEXP m) {
 }
 
 
+
+// [[Rcpp::export(rng = false)]]
+List defm_profile_cpp(SEXP m)
+{
+
+  if (!Rf_inherits(m, "DEFM"))
+    stop("defm_profile() requires an object of class DEFM.");
+
+  Rcpp::XPtr< defm::DEFM > ptr(m);
+  const DEFMProfile * profile = as_profile(m);
+  const DEFMSupportStore * store = as_native_init(m);
+
+  // Sizes of the supports and observed statistics, from whichever
+  // initialization the model has.
+  size_t n_arrays, n_supports;
+  double bytes_support = 0.0, bytes_target = 0.0;
+
+  if (store != nullptr)
+  {
+
+    n_arrays   = store->n_arrays();
+    n_supports = store->n_support();
+
+    bytes_support = sizeof(double) * store->support.size() +
+      sizeof(size_t) * (
+        store->support_nrow.size() + store->arrays2support.size() +
+        store->owners.size()
+      );
+
+    // Kept to extend the supports when terms are added
+    for (size_t s = 0u; s < store->rows.size(); ++s)
+      bytes_support += store->rows[s].bytes() +
+        sizeof(double) * store->stats[s].size();
+
+    bytes_target = sizeof(double) * store->target.size() +
+      sizeof(size_t) * (store->target_loc.size() + store->starts.size());
+
+    // Multipliers of the groups (init_defm(factor_covar = TRUE))
+    bytes_target += sizeof(double) * (
+      store->group_scale.size() + store->group_narrays.size()
+    ) + sizeof(size_t) * (
+      store->group_support.size() + store->arrays2group.size()
+    );
+
+  } else {
+
+    n_arrays   = ptr->get_arrays2support()->size();
+    n_supports = ptr->get_stats_support_sizes()->size();
+
+    bytes_support = sizeof(double) * ptr->get_stats_support()->size() +
+      sizeof(size_t) * (n_supports + n_arrays);
+
+    for (const auto & t : *ptr->get_stats_target())
+      bytes_target += sizeof(std::vector< double >) + sizeof(double) * t.size();
+
+  }
+
+  if (n_arrays == 0u)
+    stop("The model has not been initialized. Use init_defm() first.");
+
+  // Arrays that reused the support of a previous one
+  double hits = (n_arrays > n_supports) ?
+    static_cast< double >(n_arrays - n_supports) : 0.0;
+
+  List time = List::create(
+    _["init"]       = profile->time_init,
+    _["hash"]       = profile->time_hash,
+    _["enumerate"]  = profile->time_enumerate,
+    _["stats"]      = profile->time_stats,
+    _["likelihood"] = profile->time_likelihood
+  );
+
+  List counts = List::create(
+    _["arrays"]       = static_cast< double >(n_arrays),
+    _["supports"]     = static_cast< double >(n_supports),
+    _["cache_hits"]   = hits,
+    _["cache_misses"] = static_cast< double >(n_supports),
+    _["likelihood"]   = static_cast< double >(profile->n_likelihood),
+    _["init_ncores"]  = profile->init_ncores,
+    _["enum_gray"]    = static_cast< double >(profile->n_enum_gray),
+    _["enum_pruned"]  = static_cast< double >(profile->n_enum_pruned),
+    _["enum_barry"]   = static_cast< double >(profile->n_enum_barry)
+  );
+
+  List bytes = List::create(
+    _["support"] = bytes_support,
+    _["target"]  = bytes_target,
+    _["data"]    = static_cast< double >(profile->bytes_data)
+  );
+
+  return List::create(
+    _["time"]   = time,
+    _["counts"] = counts,
+    _["bytes"]  = bytes
+  );
+
+}
+
+// [[Rcpp::export(rng = false)]]
+DataFrame defm_hash_diagnostics_cpp(SEXP m, int nsample = 20, int ncores = 1)
+{
+
+  Rcpp::XPtr< defm::DEFM > ptr(m);
+
+  if (ptr->nterms() == 0u)
+    stop("The model has no terms.");
+
+  DEFMHashDiagnostics diag;
+  defm_hash_diagnostics(
+    *ptr, diag, static_cast< size_t >(std::max(nsample, 0)), ncores
+  );
+
+  const size_t k = ptr->nterms();
+
+  // barry stores each row of a support as (weight, k statistics)
+  const double bytes_per_support =
+    diag.rows_per_support * static_cast< double >(k + 1u) * sizeof(double);
+
+  NumericVector distinct(k), without(k), multiplier(k), extra(k),
+    bytes(k), secs(k);
+
+  for (size_t j = 0u; j < k; ++j)
+  {
+
+    distinct[j]   = static_cast< double >(diag.distinct[j]);
+    without[j]    = static_cast< double >(diag.supports_without[j]);
+    multiplier[j] = static_cast< double >(diag.n_supports) / without[j];
+    extra[j]      = static_cast< double >(diag.n_supports) - without[j];
+    bytes[j]      = extra[j] * bytes_per_support;
+    secs[j]       = extra[j] * diag.secs_per_support;
+
+  }
+
+  DataFrame res = DataFrame::create(
+    _["term"]             = wrap(ptr->colnames()),
+    _["distinct_hashes"]  = distinct,
+    _["supports_without"] = without,
+    _["multiplier"]       = multiplier,
+    _["extra_supports"]   = extra,
+    _["extra_bytes"]      = bytes,
+    _["extra_seconds"]    = secs,
+    _["stringsAsFactors"] = false
+  );
+
+  res.attr("n_arrays")          = static_cast< double >(diag.n_arrays);
+  res.attr("n_supports")        = static_cast< double >(diag.n_supports);
+  res.attr("n_sampled")         = static_cast< double >(diag.n_sampled);
+  res.attr("rows_per_support")  = diag.rows_per_support;
+  res.attr("bytes_per_support") = bytes_per_support;
+  res.attr("secs_per_support")  = diag.secs_per_support;
+
+  return res;
+
+}
+
+//' Approximation error of quantized covariates
+//'
+//' Estimates how far the log-likelihood of a model initialized with
+//' `init_defm(m, covar_bins = ...)` is from that of the exact model.
+//'
+//' @param m An object of class [DEFM] initialized with `covar_bins > 0`.
+//' @param par A vector of parameters of length `nterms_defm(m)`.
+//' @details
+//' When the model is initialized, the exact support sets and statistics of
+//' a sample of (up to 200, evenly spaced) arrays are kept. The error is the
+//' difference between their exact and quantized contributions to the
+//' log-likelihood at `par`, scaled to the total number of arrays.
+//' @return A named numeric vector with the estimated error
+//' (`error`, exact minus quantized), the estimated sum of the absolute errors
+//' of the arrays (`abs_error`, which bounds the absolute value of the
+//' former), the quantized log-likelihood (`loglik`), and the number of
+//' arrays in the sample (`n_sample`).
+//' @export
+//' @examples
+//' data(valentesnsList)
+//'
+//' mymodel <- new_defm(
+//'   id    = valentesnsList$id,
+//'   Y     = valentesnsList$Y,
+//'   X     = valentesnsList$X,
+//'   order = 1
+//' )
+//'
+//' td_logit_intercept(mymodel)
+//' td_formula(mymodel, "{y0} x exposure_drink")
+//' init_defm(mymodel, covar_bins = 5)
+//'
+//' covar_bins_error(mymodel, c(-1, -1, -1, .5))
+// [[Rcpp::export(rng = false)]]
+NumericVector covar_bins_error(SEXP m, const std::vector< double > & par)
+{
+
+  const DEFMSupportStore * store = as_native_init(m);
+  if ((store == nullptr) || (store->covar_bins == 0))
+    stop("The model was not initialized with -covar_bins-.");
+
+  if (par.size() != store->k)
+    stop(
+      "The length of -par- (" + std::to_string(par.size()) +
+      ") does not match the number of terms (" +
+      std::to_string(store->k) + ")."
+      );
+
+  double error, abs_error;
+  defm_quantized_error(*store, &par[0u], error, abs_error);
+
+  return NumericVector::create(
+    _["error"]     = error,
+    _["abs_error"] = abs_error,
+    _["loglik"]    = store->likelihood().eval(&par[0u]),
+    _["n_sample"]  = static_cast< double >(store->check_arrays.size())
+  );
+
+}
@@ -0,0 +1,80 @@
+#ifndef DEFM_PROFILE_H
+#define DEFM_PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+// Counters and timers collected while using a model (see defm_profile().)
+// Times are in seconds and accumulate across calls; a time that was never
+// measured is NaN.
+class DEFMProfile {
+public:
+
+  static constexpr double na = std::numeric_limits< double >::quiet_NaN();
+
+  // Initialization (last call to init_defm())
+  int init_ncores       = 0;     ///< Threads used (0 if never initialized.)
+  double time_init      = na;    ///< Total.
+  double time_hash      = na;    ///< Hashing and deduplicating the arrays.
+  double time_enumerate = na;    ///< Enumerating the unique supports.
+  double time_stats     = na;    ///< Observed statistics and layout.
+
+  // How the unique supports were enumerated: with the compiled terms, in
+  // Gray-code order (no rules) or pruned by the rules, or by barry.
+  uint64_t n_enum_gray   = 0u;
+  uint64_t n_enum_pruned = 0u;
+  uint64_t n_enum_barry  = 0u;
+
+  // Likelihood (all calls, including the ones made by the optimizer)
+  uint64_t n_likelihood  = 0u;   ///< Number of evaluations.
+  double time_likelihood = 0.0;  ///< Total.
+
+  // Data held by the model (copy_data = TRUE or read from a file)
+  uint64_t bytes_data = 0u;
+
+  void reset_init() {
+    init_ncores    = 0;
+    time_init      = na;
+    time_hash      = na;
+    time_enumerate = na;
+    time_stats     = na;
+    n_enum_gray    = 0u;
+    n_enum_pruned  = 0u;
+    n_enum_barry   = 0u;
+  };
+
+};
+
+// Adds the time elapsed between its construction and destruction (or the
+// call to stop()) to `target`. A NaN target is taken as zero.
+class DEFMTimer {
+private:
+
+  double * target;
+  std::chrono::steady_clock::time_point start;
+
+public:
+
+  DEFMTimer(double * target_) :
+    target(target_), start(std::chrono::steady_clock::now()) {};
+
+  ~DEFMTimer() {stop();};
+
+  void stop() {
+
+    if (target == nullptr)
+      return;
+
+    double secs = std::chrono::duration< double >(
+      std::chrono::steady_clock::now() - start
+    ).count();
+
+    *target = (*target != *target) ? secs : (*target + secs);
+    target  = nullptr;
+
+  };
+
+};
+
+#endif
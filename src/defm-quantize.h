@@ -0,0 +1,256 @@
+#ifndef DEFM_QUANTIZE_H
+#define DEFM_QUANTIZE_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "defm-init.h"
+
+// Snaps each covariate (column of the n x n_x, column-major, `X`) to
+// `bins` quantile bins: the distinct values are split into bins holding
+// (about) the same number of rows, and each value is replaced by the mean
+// of the values in its bin. Covariates with at most `bins` distinct values
+// (e.g., binary ones) and missing values are left as they are.
+inline std::vector< double > defm_quantize_covariates(
+  const double * X,
+  size_t n,
+  size_t n_x,
+  size_t bins
+) {
+
+  std::vector< double > res(X, X + n * n_x);
+
+  std::vector< size_t > ord;
+  for (size_t x = 0u; x < n_x; ++x)
+  {
+
+    double * col = &res[x * n];
+
+    ord.clear();
+    for (size_t i = 0u; i < n; ++i)
+      if (!std::isnan(col[i]))
+        ord.push_back(i);
+
+    std::sort(ord.begin(), ord.end(), [col](size_t i, size_t j) {
+      return col[i] < col[j];
+    });
+
+    const size_t m = ord.size();
+
+    size_t n_distinct = 0u;
+    for (size_t i = 0u; i < m; ++i)
+      if ((i == 0u) || (col[ord[i]] != col[ord[i - 1u]]))
+        n_distinct++;
+
+    if (n_distinct <= bins)
+      continue;
+
+    // Bin of each run of equal values: the position of its first row in
+    // the sorted data (so ties stay together.)
+    std::vector< size_t > bin(m);
+    for (size_t i = 0u; i < m; ++i)
+      bin[i] = ((i > 0u) && (col[ord[i]] == col[ord[i - 1u]])) ?
+        bin[i - 1u] : (i * bins / m);
+
+    for (size_t i = 0u; i < m; )
+    {
+
+      size_t end = i;
+      double sum = 0.0;
+      while ((end < m) && (bin[end] == bin[i]))
+        sum += col[ord[end++]];
+
+      const double mean = sum / static_cast< double >(end - i);
+      for (size_t l = i; l < end; ++l)
+        col[ord[l]] = mean;
+
+      i = end;
+
+    }
+
+  }
+
+  return res;
+
+}
+
+// Initializes the model as defm_init_parallel() does, but with the
+// covariates snapped to `bins` quantile bins (see
+// defm_quantize_covariates()), so arrays with close covariate values share
+// their supports. The result is the model for the quantized covariates.
+//
+// To tell how far it is from the exact model, the exact supports and
+// statistics of `nsample` arrays (evenly spaced) are kept; see
+// defm_quantized_error().
+template< typename Interrupt >
+inline void defm_init_quantized(
+  defm::DEFM & model,
+  DEFMSupportStore & store,
+  int ncores,
+  size_t bins,
+  Interrupt check_interrupt,
+  DEFMProfile * profile = nullptr,
+  size_t nsample = 200u
+) {
+
+  if (bins < 1u)
+    throw std::invalid_argument("The number of bins must be positive.");
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const size_t k       = model.nterms();
+  const int * Y        = model.get_Y();
+
+  std::vector< double > Xq = defm_quantize_covariates(
+    model.get_X(), nrows, model.get_n_covars(), bins
+  );
+
+  defm_init_parallel(
+    model, store, false, ncores, check_interrupt, profile,
+    Xq.size() > 0u ? Xq.data() : nullptr
+  );
+
+  store.covar_bins = static_cast< int >(bins);
+
+  // Exact supports of the sample
+  DEFMTimer timer(profile ? &profile->time_stats : nullptr);
+
+  const size_t n_arrays = store.n_arrays();
+  nsample = std::min(nsample, n_arrays);
+
+  store.check_arrays.resize(nsample);
+  store.check_target.assign(nsample * k, 0.0);
+  store.check_support.assign(nsample, std::vector< double >());
+
+  DEFMThreadError err;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(store.ncores)
+  #endif
+  {
+
+    auto support = *model.get_support_fun();
+    defm::DEFMArray array;
+    defm::DEFMStatsCounter counter;
+    for (size_t j = 0u; j < k; ++j)
+      counter.add_counter((*model.get_counters())[j]);
+
+    std::vector< defm::DEFMArray > arrays;
+    std::vector< double > stats;
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+    #endif
+    for (size_t v = 0u; v < nsample; ++v)
+    {
+
+      try {
+
+        const size_t a = (nsample > 1u) ?
+          v * (n_arrays - 1u) / (nsample - 1u) : 0u;
+
+        store.check_arrays[v] = a;
+
+        fill_array_window(model, array, store.starts[a]);
+
+        arrays.clear();
+        stats.clear();
+        support.reset_array(array);
+        support.calc(&arrays, &stats);
+
+        // barry's layout, one row per array (weight one)
+        const size_t n = arrays.size();
+        auto & sup = store.check_support[v];
+        sup.reserve(n * (k + 1u));
+        for (size_t i = 0u; i < n; ++i)
+        {
+          sup.push_back(1.0);
+          sup.insert(sup.end(), &stats[i * k], &stats[i * k] + k);
+        }
+
+        const size_t last = store.starts[a] + m_order;
+        for (size_t y = 0u; y < n_y; ++y)
+          array(m_order, y) = Y[y * nrows + last];
+
+        counter.reset_array(&array);
+        std::vector< double > obs = counter.count_all();
+        std::copy(obs.begin(), obs.end(), &store.check_target[v * k]);
+
+      } catch (const std::exception & e) {
+        err.set(e);
+      }
+
+    }
+
+  }
+
+  err.rethrow();
+  check_interrupt();
+
+}
+
+// Estimates the error in the log-likelihood of a quantized model at `par`
+// by comparing, on the sampled arrays, their exact and quantized
+// contributions, scaled to all the arrays. `total` is the estimated
+// difference (exact minus quantized) and `total_abs` the estimated sum of
+// the absolute differences of the arrays (a bound on |total|.)
+inline void defm_quantized_error(
+  const DEFMSupportStore & store,
+  const double * par,
+  double & total,
+  double & total_abs
+) {
+
+  const size_t k       = store.k;
+  const size_t nsample = store.check_arrays.size();
+
+  total     = 0.0;
+  total_abs = 0.0;
+
+  if (nsample == 0u)
+    return;
+
+  DEFMLikelihood quant = store.likelihood();
+
+  std::vector< double > expo(
+    std::max(quant.nrow_max, static_cast< size_t >(1u))
+  );
+
+  for (size_t v = 0u; v < nsample; ++v)
+  {
+
+    const size_t a = store.check_arrays[v];
+    const size_t s = store.arrays2support[a];
+    const auto & sup = store.check_support[v];
+    const size_t n   = sup.size() / (k + 1u);
+
+    if (expo.size() < n)
+      expo.resize(n);
+
+    double ll_exact = -support_moments(par, sup.data(), n, k, expo.data());
+    double ll_quant = -support_moments(
+      par, quant.support[s], quant.support_nrow[s], k, expo.data()
+    );
+
+    for (size_t j = 0u; j < k; ++j)
+    {
+      ll_exact += par[j] * store.check_target[v * k + j];
+      ll_quant += par[j] * store.target[a * k + j];
+    }
+
+    total     += ll_exact - ll_quant;
+    total_abs += std::fabs(ll_exact - ll_quant);
+
+  }
+
+  const double w = static_cast< double >(store.n_arrays()) /
+    static_cast< double >(nsample);
+
+  total     *= w;
+  total_abs *= w;
+
+}
+
+#endif
@@ -0,0 +1,351 @@
+#ifndef DEFM_SIMD_H
+#define DEFM_SIMD_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+// Vectorized kernels used to compute the normalizing constants over
+// supports stored as structure-of-arrays (see DEFMLikelihood::pack().) The
+// best version the CPU supports (AVX-512, AVX2 + FMA, or plain loops) is
+// selected at runtime, so the package can be built without -march flags.
+//
+// All the vectors are padded to a multiple of DEFM_SIMD_WIDTH doubles with
+// zeros, so the kernels do not need remainder loops.
+#define DEFM_SIMD_WIDTH 8u
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+  (defined(__x86_64__) || defined(__i386__))
+#define DEFM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Plain loops (the compiler may still vectorize them for the baseline ISA)
+// a += alpha * x
+inline void defm_axpy_scalar(double * a, const double * x, double alpha, size_t n)
+{
+  for (size_t i = 0u; i < n; ++i)
+    a[i] += alpha * x[i];
+}
+
+inline double defm_dot_scalar(const double * x, const double * y, size_t n)
+{
+  double res = 0.0;
+  for (size_t i = 0u; i < n; ++i)
+    res += x[i] * y[i];
+  return res;
+}
+
+// sum_i w[i] * x[i] * y[i]
+inline double defm_dot3_scalar(
+  const double * w, const double * x, const double * y, size_t n
+) {
+  double res = 0.0;
+  for (size_t i = 0u; i < n; ++i)
+    res += w[i] * x[i] * y[i];
+  return res;
+}
+
+// out[i] = exp(x[i] - shift[i]), with x[i] <= shift[i] (e.g., the shift is
+// a maximum, as in a log-sum-exp)
+inline void defm_exp_scalar(
+  double * out, const double * x, const double * shift, size_t n
+) {
+  for (size_t i = 0u; i < n; ++i)
+    out[i] = std::exp(x[i] - shift[i]);
+}
+
+// The vectorized versions reduce the argument to r = x - m log(2), with
+// |r| <= log(2) / 2, and evaluate exp(r) with its Taylor polynomial of
+// degree 12 (within about one ulp of std::exp). Arguments below -708,
+// whose exponential is below 1e-307, are clamped there.
+#define DEFM_EXP_MIN   -708.0
+#define DEFM_LOG2E     1.4426950408889634
+#define DEFM_LN2_HI    0.693147180369123816490
+#define DEFM_LN2_LO    1.90821492927058770002e-10
+
+#ifdef DEFM_SIMD_X86
+
+__attribute__((target("avx2,fma")))
+inline __m256d defm_exp_poly_avx2(__m256d r)
+{
+  __m256d p = _mm256_set1_pd(1.0 / 479001600.0);
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 39916800.0));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 3628800.0));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 362880.0));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 40320.0));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 5040.0));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 720.0));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 120.0));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 24.0));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 6.0));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(0.5));
+  p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+  return _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+}
+
+__attribute__((target("avx2,fma")))
+inline void defm_exp_avx2(
+  double * out, const double * x, const double * shift, size_t n
+) {
+
+  const __m256d lo    = _mm256_set1_pd(DEFM_EXP_MIN);
+  const __m256d magic = _mm256_set1_pd(6755399441055744.0); // 1.5 * 2^52
+
+  for (size_t i = 0u; i < n; i += 4u)
+  {
+
+    __m256d v = _mm256_max_pd(
+      _mm256_sub_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(shift + i)), lo
+    );
+
+    // m = round(v / log(2)), read off the mantissa of m + 1.5 * 2^52
+    __m256d m = _mm256_round_pd(
+      _mm256_mul_pd(v, _mm256_set1_pd(DEFM_LOG2E)),
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC
+    );
+
+    __m256d r = _mm256_fnmadd_pd(m, _mm256_set1_pd(DEFM_LN2_HI), v);
+    r = _mm256_fnmadd_pd(m, _mm256_set1_pd(DEFM_LN2_LO), r);
+
+    // 2^m, building the exponent bits (m + 1023 is in [1, 1023])
+    __m256i e = _mm256_castpd_si256(_mm256_add_pd(m, magic));
+    e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+
+    _mm256_storeu_pd(
+      out + i, _mm256_mul_pd(defm_exp_poly_avx2(r), _mm256_castsi256_pd(e))
+    );
+
+  }
+
+}
+
+__attribute__((target("avx2,fma")))
+inline void defm_axpy_avx2(double * a, const double * x, double alpha, size_t n)
+{
+  const __m256d va = _mm256_set1_pd(alpha);
+  for (size_t i = 0u; i < n; i += 4u)
+    _mm256_storeu_pd(
+      a + i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i), _mm256_loadu_pd(a + i))
+    );
+}
+
+__attribute__((target("avx2,fma")))
+inline double defm_hsum_avx2(__m256d v)
+{
+  __m128d lo = _mm256_castpd256_pd128(v);
+  __m128d hi = _mm256_extractf128_pd(v, 1);
+  lo = _mm_add_pd(lo, hi);
+  return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__((target("avx2,fma")))
+inline double defm_dot_avx2(const double * x, const double * y, size_t n)
+{
+  __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+  for (size_t i = 0u; i < n; i += 8u)
+  {
+    acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), acc0);
+    acc1 = _mm256_fmadd_pd(
+      _mm256_loadu_pd(x + i + 4u), _mm256_loadu_pd(y + i + 4u), acc1
+    );
+  }
+  return defm_hsum_avx2(_mm256_add_pd(acc0, acc1));
+}
+
+__attribute__((target("avx2,fma")))
+inline double defm_dot3_avx2(
+  const double * w, const double * x, const double * y, size_t n
+) {
+  __m256d acc = _mm256_setzero_pd();
+  for (size_t i = 0u; i < n; i += 4u)
+    acc = _mm256_fmadd_pd(
+      _mm256_mul_pd(_mm256_loadu_pd(w + i), _mm256_loadu_pd(x + i)),
+      _mm256_loadu_pd(y + i), acc
+    );
+  return defm_hsum_avx2(acc);
+}
+
+// Some compilers warn about _mm512_reduce_add_pd(), so the lanes are added
+// after storing them
+__attribute__((target("avx512f")))
+inline double defm_hsum_avx512(__m512d v)
+{
+  alignas(64) double lanes[8u];
+  _mm512_store_pd(lanes, v);
+  return ((lanes[0u] + lanes[4u]) + (lanes[1u] + lanes[5u])) +
+    ((lanes[2u] + lanes[6u]) + (lanes[3u] + lanes[7u]));
+}
+
+// As with _mm512_reduce_add_pd(), GCC warns about the unmasked versions of
+// max, roundscale, and scalef (their pass-through is undefined), so the
+// masked ones are used with every lane set.
+__attribute__((target("avx512f")))
+inline void defm_exp_avx512(
+  double * out, const double * x, const double * shift, size_t n
+) {
+
+  const __m512d lo   = _mm512_set1_pd(DEFM_EXP_MIN);
+  const __mmask8 all = 0xFF;
+
+  for (size_t i = 0u; i < n; i += 8u)
+  {
+
+    __m512d v = _mm512_sub_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(shift + i));
+    v = _mm512_mask_max_pd(v, all, v, lo);
+
+    __m512d m = _mm512_mul_pd(v, _mm512_set1_pd(DEFM_LOG2E));
+    m = _mm512_mask_roundscale_pd(
+      m, all, m, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC
+    );
+
+    __m512d r = _mm512_fnmadd_pd(m, _mm512_set1_pd(DEFM_LN2_HI), v);
+    r = _mm512_fnmadd_pd(m, _mm512_set1_pd(DEFM_LN2_LO), r);
+
+    __m512d p = _mm512_set1_pd(1.0 / 479001600.0);
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 39916800.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 3628800.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 362880.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 40320.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 5040.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 720.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 120.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 24.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 6.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(0.5));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0));
+
+    // p * 2^m
+    _mm512_storeu_pd(out + i, _mm512_mask_scalef_pd(p, all, p, m));
+
+  }
+
+}
+
+__attribute__((target("avx512f")))
+inline void defm_axpy_avx512(double * a, const double * x, double alpha, size_t n)
+{
+  const __m512d va = _mm512_set1_pd(alpha);
+  for (size_t i = 0u; i < n; i += 8u)
+    _mm512_storeu_pd(
+      a + i, _mm512_fmadd_pd(va, _mm512_loadu_pd(x + i), _mm512_loadu_pd(a + i))
+    );
+}
+
+__attribute__((target("avx512f")))
+inline double defm_dot_avx512(const double * x, const double * y, size_t n)
+{
+  __m512d acc = _mm512_setzero_pd();
+  for (size_t i = 0u; i < n; i += 8u)
+    acc = _mm512_fmadd_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i), acc);
+  return defm_hsum_avx512(acc);
+}
+
+__attribute__((target("avx512f")))
+inline double defm_dot3_avx512(
+  const double * w, const double * x, const double * y, size_t n
+) {
+  __m512d acc = _mm512_setzero_pd();
+  for (size_t i = 0u; i < n; i += 8u)
+    acc = _mm512_fmadd_pd(
+      _mm512_mul_pd(_mm512_loadu_pd(w + i), _mm512_loadu_pd(x + i)),
+      _mm512_loadu_pd(y + i), acc
+    );
+  return defm_hsum_avx512(acc);
+}
+
+#endif
+
+// Kernels selected for this CPU
+struct DEFMKernels {
+  void (*axpy)(double *, const double *, double, size_t);
+  double (*dot)(const double *, const double *, size_t);
+  double (*dot3)(const double *, const double *, const double *, size_t);
+  void (*exp)(double *, const double *, const double *, size_t);
+  const char * name;
+};
+
+inline DEFMKernels defm_select_kernels()
+{
+
+  #ifdef DEFM_SIMD_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f"))
+    return {
+      defm_axpy_avx512, defm_dot_avx512, defm_dot3_avx512, defm_exp_avx512,
+      "avx512"
+    };
+
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return {
+      defm_axpy_avx2, defm_dot_avx2, defm_dot3_avx2, defm_exp_avx2, "avx2"
+    };
+  #endif
+
+  return {
+    defm_axpy_scalar, defm_dot_scalar, defm_dot3_scalar, defm_exp_scalar,
+    "scalar"
+  };
+
+}
+
+inline const DEFMKernels & defm_kernels()
+{
+  static const DEFMKernels kernels = defm_select_kernels();
+  return kernels;
+}
+
+inline size_t defm_simd_pad(size_t n)
+{
+  return (n + DEFM_SIMD_WIDTH - 1u) / DEFM_SIMD_WIDTH * DEFM_SIMD_WIDTH;
+}
+
+// Vector of doubles whose data starts at a 64-byte boundary (a cache line
+// and an AVX-512 register), also after copies.
+class DEFMAlignedDoubles {
+private:
+
+  std::vector< double > raw;
+  size_t off = 0u;
+  size_t n   = 0u;
+
+  void align() {
+    uintptr_t p = reinterpret_cast< uintptr_t >(raw.data());
+    off = ((64u - (p % 64u)) % 64u) / sizeof(double);
+  };
+
+public:
+
+  DEFMAlignedDoubles() {};
+
+  DEFMAlignedDoubles(const DEFMAlignedDoubles & other) {
+    assign(other.n, 0.0);
+    std::copy(other.data(), other.data() + other.n, data());
+  };
+
+  DEFMAlignedDoubles & operator=(const DEFMAlignedDoubles & other) {
+    if (this != &other)
+    {
+      assign(other.n, 0.0);
+      std::copy(other.data(), other.data() + other.n, data());
+    }
+    return *this;
+  };
+
+  void assign(size_t n_, double value) {
+    n = n_;
+    raw.assign(n + 64u / sizeof(double), value);
+    align();
+  };
+
+  double * data() {return raw.data() + off;};
+  const double * data() const {return raw.data() + off;};
+  size_t size() const noexcept {return n;};
+
+};
+
+#endif
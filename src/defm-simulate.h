@@ -0,0 +1,468 @@
+#ifndef DEFM_SIMULATE_H
+#define DEFM_SIMULATE_H
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include "defm-arrays.h"
+#include "defm-bits.h"
+#include "defm-init.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Counter-based random numbers: the uniform used by replicate `r` at row `i`
+// is a hash of (seed, r, i) (SplitMix64 finalizer), so the draws do not
+// depend on how replicates are distributed across threads.
+inline uint64_t splitmix64(uint64_t x)
+{
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+inline double counter_unif(uint64_t seed, uint64_t r, uint64_t i)
+{
+  uint64_t x = splitmix64(seed ^ splitmix64(r ^ splitmix64(i)));
+  return static_cast< double >(x >> 11) / 9007199254740992.0; // 2^53
+}
+
+// Support sets used for simulation. For each unique support (keyed by the
+// counters' hash, like barry does), it stores the possible values of the
+// last row of the array, their cumulative probabilities under `par`, and
+// their sufficient statistics (in barry's layout: a weight followed by the
+// k statistics, so they can be used with support_moments().)
+// Lookups are read-only and can be done from multiple threads; new supports
+// are enumerated with the model's own support function (so the rules are
+// honored), which must happen in the main thread. The possible last rows
+// are kept sorted, as in DEFMSupportStore, so the cache can be seeded with
+// the supports of the model's native initialization (see seed()) and the
+// draws are the same either way.
+class DEFMSimSupport {
+private:
+
+  defm::DEFM * model;
+  std::vector< double > par;
+  size_t n_y;
+  size_t m_order;
+
+  std::map< std::vector< double >, size_t > keys;
+  std::vector< DEFMBitRows > rows;          ///< Possible last rows.
+  std::vector< std::vector< double > > cdf; ///< Cumulative probabilities.
+  std::vector< std::vector< double > > stats_support; ///< n x (1 + k).
+
+public:
+
+  DEFMSimSupport(defm::DEFM & model_, const std::vector< double > & par_) :
+    model(&model_), par(par_), n_y(model_.get_n_y()),
+    m_order(model_.get_m_order()) {};
+
+  std::vector< double > hash(const defm::DEFMArray & array) const {
+    return model->get_counters()->gen_hash(array);
+  };
+
+  // Returns the index of the support or -1 if it is not yet available.
+  int find(const std::vector< double > & key) const {
+    auto loc = keys.find(key);
+    return (loc == keys.end()) ? -1 : static_cast< int >(loc->second);
+  };
+
+  size_t add(const std::vector< double > & key, const defm::DEFMArray & array);
+
+  // Adds a support given its possible last rows (sorted) and their
+  // statistics (n x k).
+  size_t add(
+    const std::vector< double > & key,
+    const DEFMBitRows & rows_s,
+    const double * stats
+  );
+
+  // Adds the supports of a native initialization (see defm_init_parallel()),
+  // keyed by the hash of their first array, so they are not enumerated
+  // again. Factored, quantized, or outdated stores are skipped.
+  void seed(const DEFMSupportStore & store, int ncores);
+
+  // Samples one of the possible last rows (returns its index)
+  size_t sample(size_t s, double u) const {
+
+    const auto & c = cdf[s];
+    size_t loc = static_cast< size_t >(
+      std::upper_bound(c.begin(), c.end(), u) - c.begin()
+    );
+
+    if (loc >= c.size())
+      loc = c.size() - 1u;
+
+    return loc;
+
+  };
+
+  int cell(size_t s, size_t loc, size_t y) const {
+    return rows[s].get(loc, y);
+  };
+
+  const double * stats(size_t s) const {return stats_support[s].data();};
+  size_t nrow(size_t s) const {return cdf[s].size();};
+  size_t size() const noexcept {return rows.size();};
+
+};
+
+inline size_t DEFMSimSupport::add(
+  const std::vector< double > & key,
+  const defm::DEFMArray & array
+) {
+
+  auto loc = keys.find(key);
+  if (loc != keys.end())
+    return loc->second;
+
+  // Enumerating the support using the model's counters and rules
+  auto * support = model->get_support_fun();
+  support->reset_array(array);
+
+  std::vector< defm::DEFMArray > arrays;
+  std::vector< double > stats;
+  support->calc(&arrays, &stats);
+
+  size_t n = arrays.size();
+  size_t k = par.size();
+
+  if ((n == 0u) || (stats.size() != (n * k)))
+    throw std::logic_error(
+      "The support of the array is empty or does not match the number of terms."
+    );
+
+  // Sorting the rows (and their statistics)
+  DEFMBitRows packed(n_y, n);
+  std::vector< int > cells(n_y);
+  for (size_t r = 0u; r < n; ++r)
+  {
+
+    for (size_t y = 0u; y < n_y; ++y)
+      cells[y] = arrays[r].get_cell(m_order, y, false);
+
+    packed.set_row(r, cells.data());
+
+  }
+
+  const size_t nw = packed.words();
+  std::vector< size_t > ord(n);
+  for (size_t r = 0u; r < n; ++r)
+    ord[r] = r;
+
+  std::sort(ord.begin(), ord.end(), [&](size_t a, size_t b) {
+    return std::lexicographical_compare(
+      packed.row(a), packed.row(a) + nw, packed.row(b), packed.row(b) + nw
+    );
+  });
+
+  DEFMBitRows rows_s(n_y, n);
+  std::vector< double > stats_s(n * k);
+  for (size_t r = 0u; r < n; ++r)
+  {
+
+    rows_s.copy_row(r, packed, ord[r]);
+    std::copy(
+      stats.begin() + ord[r] * k, stats.begin() + (ord[r] + 1u) * k,
+      stats_s.begin() + r * k
+    );
+
+  }
+
+  return add(key, rows_s, stats_s.data());
+
+}
+
+inline size_t DEFMSimSupport::add(
+  const std::vector< double > & key,
+  const DEFMBitRows & rows_s,
+  const double * stats
+) {
+
+  auto loc = keys.find(key);
+  if (loc != keys.end())
+    return loc->second;
+
+  size_t n = rows_s.size();
+  size_t k = par.size();
+
+  std::vector< double > cdf_s(n);
+  std::vector< double > stats_s(n * (k + 1u));
+
+  double amax = -std::numeric_limits< double >::infinity();
+  for (size_t r = 0u; r < n; ++r)
+  {
+
+    stats_s[r * (k + 1u)] = 1.0;
+
+    double a = 0.0;
+    for (size_t j = 0u; j < k; ++j)
+    {
+      stats_s[r * (k + 1u) + 1u + j] = stats[r * k + j];
+      a += par[j] * stats[r * k + j];
+    }
+
+    cdf_s[r] = a;
+    amax = std::max(amax, a);
+
+  }
+
+  double total = 0.0;
+  for (size_t r = 0u; r < n; ++r)
+  {
+    total   += std::exp(cdf_s[r] - amax);
+    cdf_s[r] = total;
+  }
+
+  for (auto & c : cdf_s)
+    c /= total;
+
+  keys[key] = rows.size();
+  rows.push_back(rows_s);
+  cdf.push_back(std::move(cdf_s));
+  stats_support.push_back(std::move(stats_s));
+
+  return rows.size() - 1u;
+
+}
+
+inline void DEFMSimSupport::seed(const DEFMSupportStore & store, int ncores)
+{
+
+  if (
+    store.factored || (store.covar_bins > 0) || (store.k != par.size()) ||
+    (store.rows.size() != store.owners.size()) ||
+    (store.stats.size() != store.owners.size())
+  )
+    return;
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  // Hashing the first array of each support (in parallel), then adding them
+  const size_t n_support = store.owners.size();
+  std::vector< std::vector< double > > skeys(n_support);
+  DEFMThreadError err;
+
+  #ifdef _OPENMP
+  #pragma omp parallel num_threads(ncores)
+  #endif
+  {
+
+    defm::DEFMArray array;
+
+    #ifdef _OPENMP
+    #pragma omp for schedule(static)
+    #endif
+    for (size_t s = 0u; s < n_support; ++s)
+    {
+
+      try {
+        fill_array_window(*model, array, store.starts[store.owners[s]]);
+        skeys[s] = hash(array);
+      } catch (const std::exception & e) {
+        err.set(e);
+      }
+
+    }
+
+  }
+
+  err.rethrow();
+
+  for (size_t s = 0u; s < n_support; ++s)
+    add(skeys[s], store.rows[s], store.stats[s].data());
+
+}
+
+// Simulates `nsim` replicates of the model's data, writing them into `out`,
+// a column-major (nrows x n_y x nsim) array. Replicates move forward one row
+// at a time: first, in parallel, each replicate builds its array, looks up
+// its support and samples the new row; then the supports that were missing
+// are enumerated (serially) and the pending replicates are sampled. Rows
+// that are the starting condition of an id are copied from the data if
+// `fill_t0` is true, otherwise they are set to -1.
+//
+// If `draws` is not null, it is filled with (nrows x nsim) pairs (support,
+// index within the support) of the sampled rows (-1 for starting rows),
+// which, together with `supports`, fully describe the likelihood of each
+// replicate.
+template< typename Interrupt >
+inline void defm_simulate(
+  defm::DEFM & model,
+  DEFMSimSupport & supports,
+  uint64_t seed,
+  size_t nsim,
+  bool fill_t0,
+  int * out,
+  int ncores,
+  Interrupt check_interrupt,
+  std::vector< int > * draws = nullptr
+) {
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const int * ID       = model.get_ID();
+  const int * Y        = model.get_Y();
+  const size_t nsize   = nrows * n_y;
+
+  #ifndef _OPENMP
+  ncores = 1;
+  #endif
+  if (ncores < 1)
+    ncores = 1;
+
+  // Starting rows are fixed
+  std::vector< bool > is_start(nrows, false);
+  size_t n_obs_i = 0u;
+  for (size_t i = 0u; i < nrows; ++i)
+  {
+
+    if ((i > 0) && (ID[i - 1u] != ID[i]))
+      n_obs_i = 0u;
+
+    is_start[i] = n_obs_i++ < m_order;
+
+  }
+
+  // Reads cell (i, y) of replicate r, using the data for starting rows
+  auto cell = [&](size_t r, size_t i, size_t y) -> int {
+    return is_start[i] ?
+      Y[y * nrows + i] :
+      out[r * nsize + y * nrows + i];
+  };
+
+  if (draws != nullptr)
+    draws->assign(2u * nrows * nsim, -1);
+
+  auto record = [&](size_t r, size_t i, size_t s, size_t loc) -> void {
+
+    for (size_t y = 0u; y < n_y; ++y)
+      out[r * nsize + y * nrows + i] = supports.cell(s, loc, y);
+
+    if (draws != nullptr)
+    {
+      (*draws)[2u * (r * nrows + i)]      = static_cast< int >(s);
+      (*draws)[2u * (r * nrows + i) + 1u] = static_cast< int >(loc);
+    }
+
+  };
+
+  std::vector< int > pending(nsim, -1);
+  std::vector< std::vector< double > > pending_keys(nsim);
+
+  for (size_t i = 0u; i < nrows; ++i)
+  {
+
+    if (is_start[i])
+    {
+
+      for (size_t r = 0u; r < nsim; ++r)
+        for (size_t y = 0u; y < n_y; ++y)
+          out[r * nsize + y * nrows + i] = fill_t0 ? Y[y * nrows + i] : -1;
+
+      continue;
+
+    }
+
+    size_t start = i - m_order;
+    bool any_pending = false;
+
+    #ifdef _OPENMP
+    #pragma omp parallel num_threads(ncores) reduction(||:any_pending)
+    #endif
+    {
+
+      // All replicates share the covariates of the row
+      defm::DEFMArray array;
+      init_array_window(model, array, start);
+
+      #ifdef _OPENMP
+      #pragma omp for schedule(static)
+      #endif
+      for (size_t r = 0u; r < nsim; ++r)
+      {
+
+        for (size_t t = 0u; t < m_order; ++t)
+          for (size_t y = 0u; y < n_y; ++y)
+            array(t, y) = cell(r, start + t, y);
+
+        for (size_t y = 0u; y < n_y; ++y)
+          array(m_order, y) = 0;
+
+        std::vector< double > key = supports.hash(array);
+        int s = supports.find(key);
+
+        if (s < 0)
+        {
+          pending[r]      = 1;
+          pending_keys[r] = std::move(key);
+          any_pending     = true;
+          continue;
+        }
+
+        size_t loc = supports.sample(
+          static_cast< size_t >(s), counter_unif(seed, r, i)
+        );
+
+        record(r, i, static_cast< size_t >(s), loc);
+
+      }
+
+    }
+
+    if (!any_pending)
+      continue;
+
+    // New supports are enumerated in the main thread
+    defm::DEFMArray array;
+    init_array_window(model, array, start);
+    for (size_t r = 0u; r < nsim; ++r)
+    {
+
+      if (pending[r] < 0)
+        continue;
+
+      int s = supports.find(pending_keys[r]);
+      if (s < 0)
+      {
+
+        for (size_t t = 0u; t < m_order; ++t)
+          for (size_t y = 0u; y < n_y; ++y)
+            array(t, y) = cell(r, start + t, y);
+
+        for (size_t y = 0u; y < n_y; ++y)
+          array(m_order, y) = 0;
+
+        s = static_cast< int >(supports.add(pending_keys[r], array));
+
+      }
+
+      size_t loc = supports.sample(
+        static_cast< size_t >(s), counter_unif(seed, r, i)
+      );
+
+      record(r, i, static_cast< size_t >(s), loc);
+
+      pending[r] = -1;
+      pending_keys[r].clear();
+
+    }
+
+    check_interrupt();
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,642 @@
+#ifndef DEFM_STREAM_H
+#define DEFM_STREAM_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include <cctype>
+#include <limits>
+#include <fstream>
+#include <unordered_set>
+#include <stdexcept>
+#include <algorithm>
+
+// Data of a model read from a file (see defm_read_csv() and
+// defm_read_panel()). Y and X are column-major, as in DEFM. Models built
+// from it use the data as a pointer (copy_data = false), so it must live
+// as long as the model does.
+struct DEFMPanelData {
+  size_t n_rows = 0u;
+  std::vector< int > ID;
+  std::vector< int > Y;
+  std::vector< double > X;
+  std::vector< std::string > Y_names, X_names;
+};
+
+// Checks, row by row, that the ids are contiguous (all the rows of an id
+// next to each other), which is what DEFM assumes.
+class DEFMIdChecker {
+private:
+  std::unordered_set< int > done;
+  int prev    = 0;
+  bool first  = true;
+public:
+  // `unit` and `pos` (e.g., "line" and 10) are used in the error message.
+  void check(int id, const char * unit, size_t pos) {
+
+    if (!first && (id == prev))
+      return;
+
+    if (!first)
+      done.insert(prev);
+
+    if (done.find(id) != done.end())
+      throw std::runtime_error(
+        "The rows of id " + std::to_string(id) + " are not contiguous (" +
+        unit + " " + std::to_string(pos) + "). The data must be sorted by id."
+      );
+
+    prev  = id;
+    first = false;
+
+  };
+};
+
+// Binary panel format (version 1): the header below, the column names
+// (NUL-terminated, n_y Y names followed by n_x X names), and then n_rows
+// row-major records of
+//
+//   id int32, y int32 [n_y], x double [n_x]
+//
+// so files can be written (and appended to) in chunks, see
+// defm_write_panel(). The byte order is that of the machine that wrote it.
+#define DEFM_PANEL_MAGIC   "DEFMPNL"
+#define DEFM_PANEL_VERSION 1u
+#define DEFM_PANEL_ENDIAN  0x01020304u
+
+struct DEFMPanelHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t n_rows, n_y, n_x, size_names;
+};
+
+inline size_t defm_panel_record_size(uint64_t n_y, uint64_t n_x)
+{
+  return sizeof(int32_t) * (1u + n_y) + sizeof(double) * n_x;
+}
+
+// Panels can be larger than 2GB, so offsets are 64-bit
+inline int defm_fseek(std::FILE * f, uint64_t off)
+{
+  #ifdef _WIN32
+  return _fseeki64(f, static_cast< __int64 >(off), SEEK_SET);
+  #else
+  return fseeko(f, static_cast< off_t >(off), SEEK_SET);
+  #endif
+}
+
+inline bool defm_is_panel(const std::string & path)
+{
+
+  char magic[8] = {0};
+  std::FILE * f = std::fopen(path.c_str(), "rb");
+  if (f == nullptr)
+    return false;
+
+  size_t n = std::fread(magic, 1u, sizeof(magic), f);
+  std::fclose(f);
+
+  return (n == sizeof(magic)) &&
+    (std::memcmp(magic, DEFM_PANEL_MAGIC, sizeof(DEFM_PANEL_MAGIC)) == 0);
+
+}
+
+// Reads and checks the header (and the names) of a panel file, leaving `f`
+// at the first record.
+inline DEFMPanelHeader defm_panel_header(
+  std::FILE * f,
+  const std::string & path,
+  std::vector< std::string > & Y_names,
+  std::vector< std::string > & X_names
+) {
+
+  DEFMPanelHeader h;
+  if (std::fread(&h, sizeof(h), 1u, f) != 1u ||
+    (std::memcmp(h.magic, DEFM_PANEL_MAGIC, sizeof(DEFM_PANEL_MAGIC)) != 0))
+    throw std::runtime_error("The file " + path + " is not a DEFM panel file.");
+
+  if (h.endian != DEFM_PANEL_ENDIAN)
+    throw std::runtime_error(
+      "The file " + path + " was written on a machine with a different byte order."
+    );
+
+  if (h.version != DEFM_PANEL_VERSION)
+    throw std::runtime_error(
+      "Unsupported DEFM panel file version (" + std::to_string(h.version) + ")."
+    );
+
+  std::vector< char > names(h.size_names);
+  if ((h.size_names > 0u) &&
+    (std::fread(names.data(), 1u, names.size(), f) != names.size()))
+    throw std::runtime_error("The file " + path + " is truncated.");
+
+  Y_names.clear();
+  X_names.clear();
+  size_t pos = 0u;
+  for (uint64_t j = 0u; j < (h.n_y + h.n_x); ++j)
+  {
+
+    const char * start = names.data() + pos;
+    const char * end   = (pos < names.size()) ? static_cast< const char * >(
+      std::memchr(start, '\0', names.size() - pos)
+    ) : nullptr;
+
+    if (end == nullptr)
+      throw std::runtime_error("The column names in " + path + " are corrupted.");
+
+    std::string name(start, static_cast< size_t >(end - start));
+    pos += name.size() + 1u;
+
+    if (j < h.n_y)
+      Y_names.push_back(name);
+    else
+      X_names.push_back(name);
+
+  }
+
+  return h;
+
+}
+
+// Writes (or appends) rows to a panel file. When appending, the names must
+// match those already in the file.
+inline void defm_write_panel(
+  const std::string & path,
+  const int * ID,
+  const int * Y,
+  const double * X,
+  size_t n_rows,
+  const std::vector< std::string > & Y_names,
+  const std::vector< std::string > & X_names,
+  bool append
+) {
+
+  const size_t n_y = Y_names.size();
+  const size_t n_x = X_names.size();
+
+  DEFMPanelHeader h;
+  std::FILE * f = nullptr;
+
+  if (append && defm_is_panel(path))
+  {
+
+    f = std::fopen(path.c_str(), "r+b");
+    if (f == nullptr)
+      throw std::runtime_error("Cannot open the file " + path + " for writing.");
+
+    std::vector< std::string > yn, xn;
+    try {
+      h = defm_panel_header(f, path, yn, xn);
+    } catch (...) {
+      std::fclose(f);
+      throw;
+    }
+
+    if ((yn != Y_names) || (xn != X_names))
+    {
+      std::fclose(f);
+      throw std::runtime_error(
+        "The columns do not match those of the file " + path + "."
+      );
+    }
+
+    // Records go right after the last complete one
+    uint64_t end = sizeof(h) + h.size_names +
+      h.n_rows * defm_panel_record_size(n_y, n_x);
+
+    if (defm_fseek(f, end) != 0)
+    {
+      std::fclose(f);
+      throw std::runtime_error("The file " + path + " is truncated.");
+    }
+
+  } else {
+
+    if (append)
+    {
+      std::ifstream exists(path);
+      if (exists)
+        throw std::runtime_error(
+          "The file " + path + " is not a DEFM panel file."
+        );
+    }
+
+    std::string names;
+    for (const auto & n : Y_names)
+      names.append(n.c_str(), n.size() + 1u);
+    for (const auto & n : X_names)
+      names.append(n.c_str(), n.size() + 1u);
+
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, DEFM_PANEL_MAGIC, sizeof(DEFM_PANEL_MAGIC));
+    h.version    = DEFM_PANEL_VERSION;
+    h.endian     = DEFM_PANEL_ENDIAN;
+    h.n_y        = n_y;
+    h.n_x        = n_x;
+    h.size_names = names.size();
+
+    f = std::fopen(path.c_str(), "wb");
+    if (f == nullptr)
+      throw std::runtime_error("Cannot open the file " + path + " for writing.");
+
+    if ((std::fwrite(&h, sizeof(h), 1u, f) != 1u) ||
+      (std::fwrite(names.data(), 1u, names.size(), f) != names.size()))
+    {
+      std::fclose(f);
+      throw std::runtime_error("Error while writing the file " + path + ".");
+    }
+
+  }
+
+  // Records are written in chunks through a buffer
+  const size_t rsize = defm_panel_record_size(n_y, n_x);
+  const size_t chunk = std::max< size_t >(1u, (1u << 20) / rsize);
+  std::vector< char > buffer(chunk * rsize);
+
+  bool ok = true;
+  for (size_t i0 = 0u; ok && (i0 < n_rows); i0 += chunk)
+  {
+
+    size_t i1 = std::min(n_rows, i0 + chunk);
+    char * p  = buffer.data();
+    for (size_t i = i0; i < i1; ++i)
+    {
+
+      int32_t v = ID[i];
+      std::memcpy(p, &v, sizeof(v));
+      p += sizeof(v);
+
+      for (size_t y = 0u; y < n_y; ++y)
+      {
+        v = Y[y * n_rows + i];
+        std::memcpy(p, &v, sizeof(v));
+        p += sizeof(v);
+      }
+
+      for (size_t x = 0u; x < n_x; ++x)
+      {
+        std::memcpy(p, &X[x * n_rows + i], sizeof(double));
+        p += sizeof(double);
+      }
+
+    }
+
+    ok = std::fwrite(buffer.data(), rsize, i1 - i0, f) == (i1 - i0);
+
+  }
+
+  // Updating the number of rows once the records are in
+  h.n_rows += n_rows;
+  ok = ok && (std::fflush(f) == 0) && (defm_fseek(f, 0u) == 0) &&
+    (std::fwrite(&h, sizeof(h), 1u, f) == 1u);
+
+  ok = (std::fclose(f) == 0) && ok;
+
+  if (!ok)
+    throw std::runtime_error("Error while writing the file " + path + ".");
+
+}
+
+// Reads a panel file in chunks of `chunk_size` records, directly into the
+// (column-major) storage of the model. `y` and `x` select the columns by
+// name (all of them if empty). `check_interrupt` is called after each chunk.
+template< typename Interrupt >
+inline void defm_read_panel(
+  const std::string & path,
+  const std::vector< std::string > & y,
+  const std::vector< std::string > & x,
+  size_t chunk_size,
+  DEFMPanelData & data,
+  Interrupt check_interrupt
+) {
+
+  std::FILE * f = std::fopen(path.c_str(), "rb");
+  if (f == nullptr)
+    throw std::runtime_error("Cannot open the file " + path + ".");
+
+  // Closes the file on every exit
+  struct Closer {
+    std::FILE * f;
+    ~Closer() {std::fclose(f);};
+  } closer{f};
+
+  std::vector< std::string > yn, xn;
+  DEFMPanelHeader h = defm_panel_header(f, path, yn, xn);
+
+  auto select = [&path](
+    const std::vector< std::string > & wanted,
+    const std::vector< std::string > & names,
+    std::vector< std::string > & out
+  ) -> std::vector< size_t > {
+
+    std::vector< size_t > idx;
+    out.clear();
+
+    if (wanted.size() == 0u)
+    {
+      for (size_t j = 0u; j < names.size(); ++j)
+        idx.push_back(j);
+      out = names;
+      return idx;
+    }
+
+    for (const auto & w : wanted)
+    {
+      auto loc = std::find(names.begin(), names.end(), w);
+      if (loc == names.end())
+        throw std::runtime_error(
+          "The column \"" + w + "\" is not in the file " + path + "."
+        );
+
+      idx.push_back(static_cast< size_t >(loc - names.begin()));
+      out.push_back(w);
+    }
+
+    return idx;
+
+  };
+
+  std::vector< size_t > y_idx = select(y, yn, data.Y_names);
+  std::vector< size_t > x_idx = select(x, xn, data.X_names);
+
+  const size_t n_rows = h.n_rows;
+  const size_t n_y    = y_idx.size();
+  const size_t n_x    = x_idx.size();
+  const size_t rsize  = defm_panel_record_size(h.n_y, h.n_x);
+
+  data.n_rows = n_rows;
+  data.ID.resize(n_rows);
+  data.Y.resize(n_rows * n_y);
+  data.X.resize(n_rows * n_x);
+
+  if (chunk_size == 0u)
+    chunk_size = 1u;
+
+  std::vector< char > buffer(std::min(chunk_size, std::max< size_t >(n_rows, 1u)) * rsize);
+  DEFMIdChecker ids;
+
+  for (size_t i0 = 0u; i0 < n_rows; i0 += chunk_size)
+  {
+
+    size_t i1 = std::min(n_rows, i0 + chunk_size);
+    if (std::fread(buffer.data(), rsize, i1 - i0, f) != (i1 - i0))
+      throw std::runtime_error("The file " + path + " is truncated.");
+
+    for (size_t i = i0; i < i1; ++i)
+    {
+
+      const char * rec = buffer.data() + (i - i0) * rsize;
+      const char * ys  = rec + sizeof(int32_t);
+      const char * xs  = ys + h.n_y * sizeof(int32_t);
+
+      int32_t v;
+      std::memcpy(&v, rec, sizeof(v));
+      ids.check(v, "record", i + 1u);
+      data.ID[i] = v;
+
+      for (size_t j = 0u; j < n_y; ++j)
+      {
+
+        std::memcpy(&v, ys + y_idx[j] * sizeof(int32_t), sizeof(v));
+        if ((v != 0) && (v != 1))
+          throw std::runtime_error(
+            "The column \"" + data.Y_names[j] + "\" must be 0/1 (record " +
+            std::to_string(i + 1u) + ")."
+          );
+
+        data.Y[j * n_rows + i] = v;
+
+      }
+
+      for (size_t j = 0u; j < n_x; ++j)
+        std::memcpy(
+          &data.X[j * n_rows + i], xs + x_idx[j] * sizeof(double),
+          sizeof(double)
+        );
+
+    }
+
+    check_interrupt();
+
+  }
+
+}
+
+// Splits a CSV line (no embedded separators or new lines within fields),
+// removing surrounding spaces and double quotes.
+inline void defm_csv_split(
+  const std::string & line,
+  char sep,
+  std::vector< std::string > & fields
+) {
+
+  fields.clear();
+  size_t start = 0u;
+  while (true)
+  {
+
+    size_t end = line.find(sep, start);
+    if (end == std::string::npos)
+      end = line.size();
+
+    size_t a = start, b = end;
+    while ((a < b) && std::isspace(static_cast< unsigned char >(line[a])))
+      ++a;
+    while ((b > a) && std::isspace(static_cast< unsigned char >(line[b - 1u])))
+      --b;
+    if (((b - a) >= 2u) && (line[a] == '"') && (line[b - 1u] == '"'))
+    {
+      ++a;
+      --b;
+    }
+
+    fields.emplace_back(line, a, b - a);
+
+    if (end == line.size())
+      break;
+
+    start = end + 1u;
+
+  }
+
+}
+
+// Reads an id-sorted CSV file (with a header) in two passes: the first one
+// counts the rows, so the storage is allocated once, and the second one
+// parses them directly into it. Only the `id`, `y`, and `x` columns are
+// kept. `check_interrupt` is called every `chunk_size` rows.
+template< typename Interrupt >
+inline void defm_read_csv(
+  const std::string & path,
+  const std::string & id,
+  const std::vector< std::string > & y,
+  const std::vector< std::string > & x,
+  char sep,
+  size_t chunk_size,
+  DEFMPanelData & data,
+  Interrupt check_interrupt
+) {
+
+  if (chunk_size == 0u)
+    chunk_size = 1u;
+
+  // Large read buffer (the default one is small for big files)
+  std::vector< char > iobuff(1u << 20);
+  std::ifstream f;
+  f.rdbuf()->pubsetbuf(iobuff.data(), iobuff.size());
+  f.open(path, std::ios::in | std::ios::binary);
+  if (!f)
+    throw std::runtime_error("Cannot open the file " + path + ".");
+
+  auto blank = [](const std::string & l) -> bool {
+    return l.find_first_not_of(" \t\r") == std::string::npos;
+  };
+
+  // First pass: counting the rows
+  std::string line;
+  if (!std::getline(f, line))
+    throw std::runtime_error("The file " + path + " is empty.");
+
+  std::vector< std::string > header;
+  if (!line.empty() && (line.back() == '\r'))
+    line.pop_back();
+  defm_csv_split(line, sep, header);
+
+  size_t n_rows = 0u, n_lines = 0u;
+  while (std::getline(f, line))
+  {
+
+    if (!blank(line))
+      ++n_rows;
+
+    if ((++n_lines % chunk_size) == 0u)
+      check_interrupt();
+
+  }
+
+  // Locating the columns
+  auto column = [&](const std::string & name) -> size_t {
+    auto loc = std::find(header.begin(), header.end(), name);
+    if (loc == header.end())
+      throw std::runtime_error(
+        "The column \"" + name + "\" is not in the file " + path + "."
+      );
+    return static_cast< size_t >(loc - header.begin());
+  };
+
+  const size_t id_idx = column(id);
+  std::vector< size_t > y_idx, x_idx;
+  for (const auto & n : y)
+    y_idx.push_back(column(n));
+  for (const auto & n : x)
+    x_idx.push_back(column(n));
+
+  const size_t n_y = y_idx.size();
+  const size_t n_x = x_idx.size();
+
+  data.n_rows  = n_rows;
+  data.Y_names = y;
+  data.X_names = x;
+  data.ID.resize(n_rows);
+  data.Y.resize(n_rows * n_y);
+  data.X.resize(n_rows * n_x);
+
+  // Second pass: parsing
+  f.clear();
+  f.seekg(0);
+  std::getline(f, line);
+
+  std::vector< std::string > fields;
+  DEFMIdChecker ids;
+  size_t lineno = 1u;
+  size_t i      = 0u;
+
+  auto where = [&]() -> std::string {
+    return "line " + std::to_string(lineno);
+  };
+
+  auto parse_int = [&](const std::string & s, const std::string & name) -> int {
+
+    char * end = nullptr;
+    errno = 0;
+    long v = std::strtol(s.c_str(), &end, 10);
+    if (s.empty() || (*end != '\0') || (errno != 0) ||
+      (v > std::numeric_limits< int >::max()) ||
+      (v < std::numeric_limits< int >::min()))
+      throw std::runtime_error(
+        "Invalid value \"" + s + "\" in column \"" + name + "\" (" + where() +
+        "). Missing values are not allowed."
+      );
+
+    return static_cast< int >(v);
+
+  };
+
+  while (std::getline(f, line) && (i < n_rows))
+  {
+
+    ++lineno;
+
+    if (blank(line))
+      continue;
+
+    if (line.back() == '\r')
+      line.pop_back();
+
+    defm_csv_split(line, sep, fields);
+    if (fields.size() != header.size())
+      throw std::runtime_error(
+        "Expected " + std::to_string(header.size()) + " fields but found " +
+        std::to_string(fields.size()) + " (" + where() + ")."
+      );
+
+    int v = parse_int(fields[id_idx], id);
+    ids.check(v, "line", lineno);
+    data.ID[i] = v;
+
+    for (size_t j = 0u; j < n_y; ++j)
+    {
+
+      v = parse_int(fields[y_idx[j]], y[j]);
+      if ((v != 0) && (v != 1))
+        throw std::runtime_error(
+          "The column \"" + y[j] + "\" must be 0/1 (" + where() + ")."
+        );
+
+      data.Y[j * n_rows + i] = v;
+
+    }
+
+    for (size_t j = 0u; j < n_x; ++j)
+    {
+
+      const std::string & s = fields[x_idx[j]];
+      char * end = nullptr;
+      double d   = std::strtod(s.c_str(), &end);
+      if (s.empty() || (*end != '\0') || std::isnan(d))
+        throw std::runtime_error(
+          "Invalid value \"" + s + "\" in column \"" + x[j] + "\" (" +
+          where() + "). Missing values are not allowed."
+        );
+
+      data.X[j * n_rows + i] = d;
+
+    }
+
+    if ((++i % chunk_size) == 0u)
+      check_interrupt();
+
+  }
+
+  if (i != n_rows)
+    throw std::runtime_error("The file " + path + " changed while reading it.");
+
+}
+
+#endif
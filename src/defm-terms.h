@@ -0,0 +1,665 @@
+#ifndef DEFM_TERMS_H
+#define DEFM_TERMS_H
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cctype>
+#include <cstdint>
+#include <algorithm>
+#include "defm-arrays.h"
+
+// barry keeps each term as a counter (a pair of closures) that is called
+// once per cell when counting an array, and cannot be inspected. So the
+// package keeps its own description of the terms, recorded as they are
+// added (see td_formula() and friends), to compile all of them into a
+// single evaluator (DEFMTermProgram.)
+
+// A term as a function of the cells of the (m_order + 1) x n_y array: the
+// indicator that the cells `coords` have the values `signs` (a motif), or
+// the number of ones among them, times a covariate of the last row.
+class DEFMTermSpec {
+public:
+
+  bool motif = true;             ///< Indicator (false: number of ones.)
+  std::vector< size_t > coords;  ///< Cells, column-major (as in td_generic().)
+  std::vector< bool > signs;     ///< Value of each cell in the motif.
+  int covar = -1;                ///< Covariate weighting the term (or -1.)
+
+};
+
+// A support rule bounding a statistic (see rule_constrain_support().)
+class DEFMTermBound {
+public:
+
+  size_t term = 0u;
+  double lb   = 0.0;
+  double ub   = 0.0;
+
+};
+
+class DEFMTermSpecs {
+public:
+
+  std::vector< DEFMTermSpec > terms;
+  bool known = true;   ///< False if some term could not be described.
+
+  // Rules (see rule_not_one_to_zero() and rule_constrain_support(), the
+  // only ones the package adds.)
+  std::vector< size_t > absorbing;       ///< Outcomes that stay at one.
+  std::vector< DEFMTermBound > bounds;   ///< Bounds on the statistics.
+
+  // Records the terms added by a call that took the model from `before` to
+  // `after` terms. If they do not add up, the terms are no longer known.
+  void add(const std::vector< DEFMTermSpec > & added, size_t before, size_t after) {
+
+    if (!known)
+      return;
+
+    if ((before != terms.size()) || ((after - before) != added.size()))
+    {
+      known = false;
+      return;
+    }
+
+    terms.insert(terms.end(), added.begin(), added.end());
+
+  };
+
+};
+
+inline std::string defm_trim(const std::string & x)
+{
+
+  size_t from = 0u, to = x.size();
+  while ((from < to) && std::isspace(static_cast< unsigned char >(x[from])))
+    from++;
+
+  while ((to > from) && std::isspace(static_cast< unsigned char >(x[to - 1u])))
+    to--;
+
+  return x.substr(from, to - from);
+
+}
+
+// Describes a formula of td_formula() ("{y0, 0y1} > {y1} x covar"). Returns
+// false if it cannot (the term is then counted by barry only.) Cells in the
+// LHS of a transition without a row id are only described for Markov
+// order 1.
+inline bool defm_parse_formula(
+  const std::string & formula,
+  size_t m_order,
+  size_t n_y,
+  const std::vector< std::string > & y_names,
+  const std::vector< std::string > & x_names,
+  DEFMTermSpec & spec
+) {
+
+  spec = DEFMTermSpec();
+
+  // Covariate after the last bracket
+  const size_t last = formula.rfind('}');
+  if (last == std::string::npos)
+    return false;
+
+  const std::string rest = defm_trim(formula.substr(last + 1u));
+  if (rest != "")
+  {
+
+    if ((rest.size() < 3u) || (rest[0u] != 'x') ||
+      !std::isspace(static_cast< unsigned char >(rest[1u])))
+      return false;
+
+    const std::string name = defm_trim(rest.substr(1u));
+    auto loc = std::find(x_names.begin(), x_names.end(), name);
+    if (loc == x_names.end())
+      return false;
+
+    spec.covar = static_cast< int >(loc - x_names.begin());
+
+  }
+
+  // Groups of cells: {...} or {...} > {...}
+  std::vector< std::string > groups;
+  size_t pos = 0u;
+  while (pos <= last)
+  {
+
+    const size_t open = formula.find('{', pos);
+    if ((open == std::string::npos) || (open > last))
+      break;
+
+    const std::string sep = defm_trim(formula.substr(pos, open - pos));
+    if (sep != (groups.size() == 0u ? "" : ">"))
+      return false;
+
+    const size_t close = formula.find('}', open);
+    groups.push_back(formula.substr(open + 1u, close - open - 1u));
+    pos = close + 1u;
+
+  }
+
+  if ((groups.size() == 0u) || (groups.size() > 2u))
+    return false;
+
+  for (size_t g = 0u; g < groups.size(); ++g)
+  {
+
+    const bool lhs = (groups.size() == 2u) && (g == 0u);
+
+    std::string cells = groups[g] + ",";
+    size_t from = 0u, comma;
+    while ((comma = cells.find(',', from)) != std::string::npos)
+    {
+
+      std::string token = defm_trim(cells.substr(from, comma - from));
+      from = comma + 1u;
+
+      if (token == "")
+        return false;
+
+      bool sign = true;
+      size_t y = n_y, row = m_order + 1u;
+
+      // Names of the outcomes first, then [0]y<col>[_<row>]
+      auto loc = std::find(y_names.begin(), y_names.end(), token);
+      if ((loc == y_names.end()) && (token[0u] == '0'))
+      {
+        loc = std::find(y_names.begin(), y_names.end(), token.substr(1u));
+        sign = loc == y_names.end();
+      }
+
+      if (loc != y_names.end())
+        y = static_cast< size_t >(loc - y_names.begin());
+      else
+      {
+
+        if (token[0u] == '0')
+        {
+          sign  = false;
+          token = token.substr(1u);
+        }
+
+        if ((token.size() < 2u) || (token[0u] != 'y'))
+          return false;
+
+        const size_t under = token.find('_');
+        const std::string col = token.substr(1u, under - 1u);
+        const std::string rid = under == std::string::npos ?
+          "" : token.substr(under + 1u);
+
+        if ((col == "") || (under != std::string::npos && rid == ""))
+          return false;
+
+        for (const auto & c : col + rid)
+          if (!std::isdigit(static_cast< unsigned char >(c)))
+            return false;
+
+        y = std::stoul(col);
+        if (rid != "")
+          row = std::stoul(rid);
+
+      }
+
+      if (row > m_order)
+      {
+
+        if (lhs && (m_order != 1u))
+          return false;
+
+        row = lhs ? 0u : m_order;
+
+      }
+
+      if ((y >= n_y) || (lhs && (row >= m_order)))
+        return false;
+
+      spec.coords.push_back(y * (m_order + 1u) + row);
+      spec.signs.push_back(sign);
+
+    }
+
+  }
+
+  return true;
+
+}
+
+// The terms compiled into masks over the bits of the array: cell (t, y) is
+// bit t * n_y + y of the window, and each term is either
+//
+//   motif:  (window & mask) == value
+//   count:  popcount(window & mask)
+//
+// times its covariate, so all the statistics are computed in one pass over
+// a few words, without calling the counters.
+class DEFMTermProgram {
+public:
+
+  size_t k       = 0u;
+  size_t n_y     = 0u;
+  size_t m_order = 0u;
+  size_t nwords  = 0u;
+  bool free_support = false;     ///< No rules: every last row is possible.
+
+  // The rules: outcomes that cannot go from one to zero, and bounds on the
+  // statistics. rules_known is false if some refer to outcomes or terms the
+  // model does not have (they are left to barry.)
+  bool rules_known = false;
+  std::vector< uint8_t > absorbing;      ///< n_y flags.
+  std::vector< DEFMTermBound > bounds;
+
+  std::vector< uint64_t > mask;  ///< k x nwords.
+  std::vector< uint64_t > value; ///< k x nwords.
+  std::vector< uint8_t > motif;
+  std::vector< int > covar;
+
+  // Terms involving each cell of the last row (cell y lists cell_terms
+  // [cell_start[y], cell_start[y + 1]), with the value each motif expects
+  // in cell_signs), so flipping a cell only updates those (DEFMTermWalk.)
+  std::vector< size_t > cell_start;
+  std::vector< size_t > cell_terms;
+  std::vector< uint8_t > cell_signs;
+
+  bool compiled() const noexcept {return k > 0u;};
+
+  size_t bit(size_t t, size_t y) const {return t * n_y + y;};
+
+  void set_cell(uint64_t * w, size_t t, size_t y, int v) const {
+    const size_t b = bit(t, y);
+    if (v != 0)
+      w[b / 64u] |= uint64_t(1u) << (b % 64u);
+    else
+      w[b / 64u] &= ~(uint64_t(1u) << (b % 64u));
+  };
+
+  // Window of the data starting at row `start` (Y is column-major)
+  void pack_window(
+    const int * Y, size_t nrows, size_t start, uint64_t * w
+  ) const {
+    std::fill(w, w + nwords, uint64_t(0u));
+    for (size_t t = 0u; t <= m_order; ++t)
+      for (size_t y = 0u; y < n_y; ++y)
+        set_cell(w, t, y, Y[y * nrows + start + t]);
+  };
+
+  // Statistics of the window `w`. `x` points to the covariates of its last
+  // row (covariate c is x[c * stride]); it can be null if no term has one.
+  void eval(
+    const uint64_t * w, const double * x, size_t stride, double * out
+  ) const;
+
+  // The terms [from, to) as a program of their own
+  DEFMTermProgram subset(size_t from, size_t to) const;
+
+  // Fills cell_start, cell_terms, and cell_signs from the masks
+  void index_cells();
+
+  // Whether cell (t, y) is part of term j, and the value its motif expects
+  bool in_term(size_t j, size_t t, size_t y) const {
+    const size_t b = bit(t, y);
+    return (mask[j * nwords + b / 64u] >> (b % 64u)) & 1u;
+  };
+
+  bool sign(size_t j, size_t t, size_t y) const {
+    const size_t b = bit(t, y);
+    return (value[j * nwords + b / 64u] >> (b % 64u)) & 1u;
+  };
+
+};
+
+inline void DEFMTermProgram::eval(
+  const uint64_t * w, const double * x, size_t stride, double * out
+) const {
+
+  if (nwords == 1u)
+  {
+
+    const uint64_t w0 = w[0u];
+    for (size_t j = 0u; j < k; ++j)
+    {
+
+      const uint64_t m = w0 & mask[j];
+      double s = motif[j] ?
+        static_cast< double >(m == value[j]) :
+        static_cast< double >(__builtin_popcountll(m));
+
+      if (covar[j] >= 0)
+        s *= x[static_cast< size_t >(covar[j]) * stride];
+
+      out[j] = s;
+
+    }
+
+    return;
+
+  }
+
+  for (size_t j = 0u; j < k; ++j)
+  {
+
+    const uint64_t * mj = &mask[j * nwords];
+    const uint64_t * vj = &value[j * nwords];
+
+    double s;
+    if (motif[j])
+    {
+      bool match = true;
+      for (size_t l = 0u; (l < nwords) && match; ++l)
+        match = (w[l] & mj[l]) == vj[l];
+      s = static_cast< double >(match);
+    } else {
+      int n = 0;
+      for (size_t l = 0u; l < nwords; ++l)
+        n += __builtin_popcountll(w[l] & mj[l]);
+      s = static_cast< double >(n);
+    }
+
+    if (covar[j] >= 0)
+      s *= x[static_cast< size_t >(covar[j]) * stride];
+
+    out[j] = s;
+
+  }
+
+}
+
+inline DEFMTermProgram DEFMTermProgram::subset(size_t from, size_t to) const
+{
+
+  DEFMTermProgram res = *this;
+  res.k = to - from;
+
+  res.mask.assign(mask.begin() + from * nwords, mask.begin() + to * nwords);
+  res.value.assign(value.begin() + from * nwords, value.begin() + to * nwords);
+  res.motif.assign(motif.begin() + from, motif.begin() + to);
+  res.covar.assign(covar.begin() + from, covar.begin() + to);
+  res.index_cells();
+
+  return res;
+
+}
+
+inline void DEFMTermProgram::index_cells()
+{
+
+  cell_start.assign(n_y + 1u, 0u);
+  cell_terms.clear();
+  cell_signs.clear();
+
+  for (size_t y = 0u; y < n_y; ++y)
+  {
+
+    const size_t b = bit(m_order, y);
+    for (size_t j = 0u; j < k; ++j)
+    {
+
+      if (((mask[j * nwords + b / 64u] >> (b % 64u)) & 1u) == 0u)
+        continue;
+
+      cell_terms.push_back(j);
+      cell_signs.push_back(static_cast< uint8_t >(
+        (value[j * nwords + b / 64u] >> (b % 64u)) & 1u
+      ));
+
+    }
+
+    cell_start[y + 1u] = cell_terms.size();
+
+  }
+
+}
+
+// Statistics of a window whose last row changes one cell at a time (e.g.,
+// walking the possible last rows in Gray-code order.) Each term keeps an
+// integer state: the number of its cells that differ from the motif, or its
+// number of ones. Flipping a cell updates the terms involving it (and only
+// those), so a step costs O(terms in the cell) instead of evaluating all
+// the terms. The statistics are the same, bit for bit, as eval()'s.
+class DEFMTermWalk {
+private:
+
+  const DEFMTermProgram * prog = nullptr;
+  std::vector< int > state;
+  std::vector< double > scale;
+
+public:
+
+  std::vector< double > stats;  ///< Statistics of the current window.
+
+  // Mismatches (motifs) or ones (counts) of term j, and its covariate
+  int count(size_t j) const {return state[j];};
+  double weight(size_t j) const {return scale[j];};
+
+  DEFMTermWalk(const DEFMTermProgram & prog_) :
+    prog(&prog_), state(prog_.k), scale(prog_.k), stats(prog_.k) {};
+
+  // Starts from the window `w` (arguments as in DEFMTermProgram::eval())
+  void reset(const uint64_t * w, const double * x, size_t stride) {
+
+    const DEFMTermProgram & p = *prog;
+    for (size_t j = 0u; j < p.k; ++j)
+    {
+
+      const uint64_t * mj = &p.mask[j * p.nwords];
+      const uint64_t * vj = &p.value[j * p.nwords];
+
+      int n = 0;
+      for (size_t l = 0u; l < p.nwords; ++l)
+        n += p.motif[j] ?
+          __builtin_popcountll((w[l] & mj[l]) ^ vj[l]) :
+          __builtin_popcountll(w[l] & mj[l]);
+
+      state[j] = n;
+      scale[j] = (p.covar[j] >= 0) ?
+        x[static_cast< size_t >(p.covar[j]) * stride] : 1.0;
+
+      update(j);
+
+    }
+
+  };
+
+  // Sets cell y of the last row, which was !v, to v
+  void flip(size_t y, int v) {
+
+    const DEFMTermProgram & p = *prog;
+    for (size_t i = p.cell_start[y]; i < p.cell_start[y + 1u]; ++i)
+    {
+
+      const size_t j = p.cell_terms[i];
+      if (p.motif[j])
+        state[j] += (static_cast< int >(p.cell_signs[i]) == v) ? -1 : 1;
+      else
+        state[j] += v ? 1 : -1;
+
+      update(j);
+
+    }
+
+  };
+
+private:
+
+  void update(size_t j) {
+
+    double s = prog->motif[j] ?
+      static_cast< double >(state[j] == 0) :
+      static_cast< double >(state[j]);
+
+    if (prog->covar[j] >= 0)
+      s *= scale[j];
+
+    stats[j] = s;
+
+  };
+
+};
+
+// Compiles the terms (an empty program if they are not all known.)
+inline DEFMTermProgram defm_compile_terms(
+  const DEFMTermSpecs & specs,
+  size_t n_y,
+  size_t m_order
+) {
+
+  DEFMTermProgram prog;
+  if (!specs.known || (specs.terms.size() == 0u))
+    return prog;
+
+  prog.n_y          = n_y;
+  prog.m_order      = m_order;
+  prog.nwords       = ((m_order + 1u) * n_y + 63u) / 64u;
+  prog.free_support = specs.absorbing.empty() && specs.bounds.empty();
+  prog.rules_known  = true;
+
+  const size_t k = specs.terms.size();
+  prog.mask.assign(k * prog.nwords, 0u);
+  prog.value.assign(k * prog.nwords, 0u);
+  prog.motif.resize(k);
+  prog.covar.resize(k);
+
+  for (size_t j = 0u; j < k; ++j)
+  {
+
+    const DEFMTermSpec & term = specs.terms[j];
+
+    prog.motif[j] = term.motif ? 1u : 0u;
+    prog.covar[j] = term.covar;
+
+    for (size_t c = 0u; c < term.coords.size(); ++c)
+    {
+
+      const size_t t = term.coords[c] % (m_order + 1u);
+      const size_t y = term.coords[c] / (m_order + 1u);
+      if (y >= n_y)
+        return DEFMTermProgram();
+
+      // A cell listed twice cannot be expressed as a mask (left to barry)
+      const size_t b = prog.bit(t, y);
+      if ((prog.mask[j * prog.nwords + b / 64u] >> (b % 64u)) & 1u)
+        return DEFMTermProgram();
+
+      prog.set_cell(&prog.mask[j * prog.nwords], t, y, 1);
+      if (term.signs[c])
+        prog.set_cell(&prog.value[j * prog.nwords], t, y, 1);
+
+    }
+
+  }
+
+  prog.absorbing.assign(n_y, 0u);
+  for (const auto & y : specs.absorbing)
+  {
+    if (y >= n_y)
+      prog.rules_known = false;
+    else
+      prog.absorbing[y] = 1u;
+  }
+
+  for (const auto & b : specs.bounds)
+    if (b.term >= k)
+      prog.rules_known = false;
+
+  prog.bounds = specs.bounds;
+
+  prog.k = k;
+  prog.index_cells();
+  return prog;
+
+}
+
+// Compiles the terms and checks the program against the model's counters
+// on `ncheck` arrays (evenly spaced), with their observed last row and up
+// to 32 other last rows each (all of them if n_y <= 5.) Returns an empty
+// program if the terms are unknown or any statistic differs.
+inline DEFMTermProgram defm_compile_checked(
+  defm::DEFM & model,
+  const DEFMTermSpecs & specs,
+  size_t ncheck = 16u
+) {
+
+  const size_t nrows   = model.get_n_rows();
+  const size_t n_y     = model.get_n_y();
+  const size_t m_order = model.get_m_order();
+  const size_t k       = model.nterms();
+  const int * Y        = model.get_Y();
+  const double * X     = model.get_X();
+
+  DEFMTermProgram prog = defm_compile_terms(specs, n_y, m_order);
+  if (!prog.compiled() || (prog.k != k))
+    return DEFMTermProgram();
+
+  std::vector< int > rows;
+  rows2arrays(model, 0u, nrows, rows);
+
+  std::vector< size_t > starts;
+  for (size_t i = 0u; i < nrows; ++i)
+    if (rows[i] >= 0)
+      starts.push_back(i - m_order);
+
+  ncheck = std::min(ncheck, starts.size());
+
+  defm::DEFMArray array;
+  defm::DEFMStatsCounter counter;
+  for (size_t j = 0u; j < k; ++j)
+    counter.add_counter((*model.get_counters())[j]);
+
+  std::vector< uint64_t > w(prog.nwords);
+  std::vector< double > stats(k);
+
+  const size_t nlast = n_y <= 5u ? (size_t(1u) << n_y) : 33u;
+
+  for (size_t v = 0u; v < ncheck; ++v)
+  {
+
+    const size_t a = (ncheck > 1u) ?
+      v * (starts.size() - 1u) / (ncheck - 1u) : 0u;
+    const size_t start = starts[a];
+
+    fill_array_window(model, array, start);
+    prog.pack_window(Y, nrows, start, w.data());
+
+    for (size_t r = 0u; r < nlast; ++r)
+    {
+
+      // The observed row first, then all the rows or pseudo-random ones
+      uint64_t h = r * 0x9E3779B97F4A7C15ULL + a;
+      h = (h ^ (h >> 31)) * 0xBF58476D1CE4E5B9ULL;
+      for (size_t y = 0u; y < n_y; ++y)
+      {
+
+        int v_y;
+        if ((nlast == (size_t(1u) << n_y)) && (n_y <= 5u))
+          v_y = static_cast< int >((r >> y) & 1u);
+        else if (r == 0u)
+          v_y = Y[y * nrows + start + m_order];
+        else
+          v_y = static_cast< int >((h >> (y % 64u)) & 1u);
+
+        array(m_order, y) = v_y;
+        prog.set_cell(w.data(), m_order, y, v_y);
+
+      }
+
+      counter.reset_array(&array);
+      const std::vector< double > expected = counter.count_all();
+      prog.eval(w.data(), X + start + m_order, nrows, stats.data());
+
+      if (expected.size() != k)
+        return DEFMTermProgram();
+
+      for (size_t j = 0u; j < k; ++j)
+        if (std::fabs(expected[j] - stats[j]) >
+          1e-10 * std::max(1.0, std::fabs(expected[j])))
+          return DEFMTermProgram();
+
+    }
+
+  }
+
+  return prog;
+
+}
+
+#endif
@@ -2,14 +2,69 @@
 
 // Lets barry check for user interrupts (Ctrl-C) during long-running
 // computations such as the support enumeration in init_defm().
-#define BARRY_USER_INTERRUPT Rcpp::checkUserInterrupt();
+#include "defm-interrupt.h"
 
 #include "barry/barry.hpp"
 #include "barry/models/defm.hpp"
 #include "defm-common.h"
+#include "defm-init.h"
+#include "defm-quantize.h"
 
 using namespace Rcpp;
 
+// If the model was initialized with init_defm(), the new terms are added to
+// the existing supports (see defm_extend_terms()), so the model does not
+// need to be initialized again. Models initialized with
+// init_defm(factor_covar = TRUE) or init_defm(covar_bins > 0) are
+// initialized again.
+static void extend_native_init(SEXP m, defm::DEFM & model)
+{
+
+  DEFMSupportStore * store = as_native_init(m);
+  if (store == nullptr)
+    return;
+
+  DEFMTermProgram program = defm_compile_checked(model, *as_term_specs(m, model));
+
+  // Factored and quantized supports are built with other covariates, so
+  // they cannot be extended column by column. If the new term cannot be
+  // factored, the old store is kept (and flagged as outdated by its k, see
+  // check_native_init().)
+  if (store->factored || (store->covar_bins > 0))
+  {
+
+    auto check_interrupt = []() -> void {Rcpp::checkUserInterrupt();};
+
+    DEFMSupportStore fresh;
+    fresh.program = std::move(program);
+    if (store->factored)
+      defm_init_factored(model, fresh, store->ncores, check_interrupt);
+    else
+      defm_init_quantized(
+        model, fresh, store->ncores,
+        static_cast< size_t >(store->covar_bins), check_interrupt
+      );
+
+    *store = std::move(fresh);
+    return;
+
+  }
+
+  store->program = std::move(program);
+  defm_extend_terms(
+    model, *store,
+    []() -> void {Rcpp::checkUserInterrupt();}
+  );
+
+}
+
+// Rules change the supports, so the initialization is no longer valid (the
+// model needs to be initialized again.)
+static void drop_native_init(SEXP m)
+{
+  Rf_setAttrib(m, Rf_install("native_init"), R_NilValue);
+}
+
 //' Model specification for DEFM
 //'
 //' @param m An object of class [DEFM].
@@ -64,11 +119,27 @@ SEXP td_ones(
   // This will set the covar index, if needed
   check_covar(idx_, covar, ptr);
 
+  DEFMTermSpecs * specs = as_term_specs(m, *ptr);
+  const size_t before   = ptr->nterms();
+
+  // The number of ones in the last row
+  DEFMTermSpec spec;
+  spec.motif = false;
+  spec.covar = idx_;
+  for (size_t y = 0u; y < ptr->get_n_y(); ++y)
+  {
+    spec.coords.push_back(y * (ptr->get_m_order() + 1u) + ptr->get_m_order());
+    spec.signs.push_back(true);
+  }
+
   defm::counter_ones(
     ptr->get_counters(), idx_,
     &ptr->get_X_names()
     );
 
+  specs->add({spec}, before, ptr->nterms());
+  extend_native_init(m, *ptr);
+
   return m;
 }
 
@@ -135,6 +206,14 @@ SEXP td_generic(
 
   }
 
+  DEFMTermSpecs * specs = as_term_specs(m, *ptr);
+  const size_t before   = ptr->nterms();
+
+  DEFMTermSpec spec;
+  spec.coords = coords;
+  spec.signs  = signs;
+  spec.covar  = idx_;
+
     defm::counter_generic(
       ptr->get_counters(), coords, signs,
       ptr->get_m_order(), ptr->get_n_y(),
@@ -143,6 +222,9 @@ SEXP td_generic(
       &ptr->get_Y_names()
     );
 
+  specs->add({spec}, before, ptr->nterms());
+  extend_native_init(m, *ptr);
+
   return m;
 
 }
@@ -202,6 +284,9 @@ SEXP td_formula(
 
   Rcpp::XPtr< defm::DEFM > ptr(m);
 
+  DEFMTermSpecs * specs = as_term_specs(m, *ptr);
+  const size_t before   = ptr->nterms();
+
   defm::counter_formula(
     ptr->get_counters(), formula,
     ptr->get_m_order(),
@@ -223,6 +308,17 @@ SEXP td_formula(
     );
   }
 
+  DEFMTermSpec spec;
+  if (defm_parse_formula(
+    formula, ptr->get_m_order(), ptr->get_n_y(),
+    ptr->get_Y_names(), ptr->get_X_names(), spec
+  ))
+    specs->add({spec}, before, ptr->nterms());
+  else
+    specs->known = false;
+
+  extend_native_init(m, *ptr);
+
   return m;
 
 }
@@ -255,6 +351,24 @@ SEXP td_logit_intercept(
     coords_.push_back(c);
   }
 
+  DEFMTermSpecs * specs = as_term_specs(m, *ptr);
+  const size_t before   = ptr->nterms();
+
+  // One term per outcome: the indicator of its last-row cell
+  std::vector< DEFMTermSpec > added;
+  const size_t n_y = ptr->get_n_y();
+  for (size_t i = 0u; i < (coords_.size() ? coords_.size() : n_y); ++i)
+  {
+    DEFMTermSpec spec;
+    spec.coords.push_back(
+      (coords_.size() ? coords_[i] : i) * (ptr->get_m_order() + 1u) +
+      ptr->get_m_order()
+    );
+    spec.signs.push_back(true);
+    spec.covar = idx_;
+    added.push_back(spec);
+  }
+
   defm::counter_logit_intercept(
     ptr->get_counters(),
     ptr->get_n_y(),
@@ -264,6 +378,9 @@ SEXP td_logit_intercept(
     &ptr->get_Y_names()
   );
 
+  specs->add(added, before, ptr->nterms());
+  extend_native_init(m, *ptr);
+
   return m;
 
 }
@@ -287,6 +404,14 @@ SEXP rule_not_one_to_zero(
     term_indices
   );
 
+  // Recorded so init_defm() can fix these cells up front
+  DEFMTermSpecs * specs = as_term_specs(m, *ptr);
+  specs->absorbing.insert(
+    specs->absorbing.end(), term_indices.begin(), term_indices.end()
+  );
+
+  drop_native_init(m);
+
   return m;
 }
 
@@ -316,6 +441,15 @@ SEXP rule_constrain_support(
     ub
   );
 
+  // Recorded so init_defm() can prune the support with it
+  DEFMTermBound bound;
+  bound.term = static_cast< size_t >(term_index);
+  bound.lb   = lb;
+  bound.ub   = ub;
+  as_term_specs(m, *ptr)->bounds.push_back(bound);
+
+  drop_native_init(m);
+
   return m;
 
 